@@ -2,14 +2,21 @@
 #define CONSTANTS
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 
 // Screen size
 #define SCREEN_WIDTH 1024
 #define SCREEN_HEIGHT 768
 
-// Frame rate
+// Simulation steps per second, and the most steps run to catch up before a
+// frame is drawn
 #define MAX_FPS 60
+#define MAX_CATCHUP 5
+
+// Rewind keeps this many steps, of games with up to REWIND_SPRITES pool slots
+#define REWIND_STEPS (10 * MAX_FPS)
+#define REWIND_SPRITES 256
 
 // Pi
 #ifndef M_PI
@@ -24,19 +31,73 @@
 #define NUM_CHANNELS 2
 #define CHUNK_SIZE 2048
 #define NUM_SFX 3
+#define MAX_VOICES 4
 
 // List of sound effects
 enum sound_effects
 { SFX_LASER, SFX_CRASH, SFX_THRUST };
 
+// Player inputs, as bits of one int
+enum inputs
+{ INPUT_UP = 1, INPUT_LEFT = 2, INPUT_RIGHT = 4, INPUT_FIRE = 8 };
+
 #define NUM_SPRITES 4
 
 // Sprite ids
 enum sprite_ids
 { ASTER, FRAGMENT, LASER, SHIP };
 
+// Printable characters rasterized into the glyph atlas
+#define FIRST_GLYPH ' '
+#define LAST_GLYPH '~'
+#define NUM_GLYPHS (LAST_GLYPH - FIRST_GLYPH + 1)
+
+#define NUM_BATCHES 4
+
+// Draw batches, flushed in this order at the end of each frame
+enum batches
+{ BATCH_LINES, BATCH_DOTS, BATCH_COOLDOWN, BATCH_TEXT };
+
+#define NUM_AUX_TEXTURES 2
+
+// Textures drawn on top of sprites, loaded once with the sprite textures
+enum aux_textures
+{ TEX_THRUST, TEX_DBG };
+
+// Stream of random numbers (xoshiro256**). Each game owns one, so games are
+// reproducible from their seed and never share hidden state.
+typedef struct Rng { uint64_t s[4]; } Rng;
+
+static inline uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+// Seed a stream, spreading the seed over the whole state with splitmix64
+static inline void seedRng(Rng* r, uint64_t seed)
+{
+    for(int i = 0; i < 4; i++) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        r->s[i] = z ^ (z >> 31);
+    }
+}
+
+// Next 64 random bits of a stream
+static inline uint64_t nextRng(Rng* r)
+{
+    uint64_t* s = r->s;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+}
+
 // Get random number in [0, 1)
-static inline double getRand(void) { return (double) rand() / (double) RAND_MAX; }
+static inline double getRand(Rng* r) { return (nextRng(r) >> 11) * 0x1.0p-53; }
 
 // Max and min
 static inline double max(double a, double b) { if(a > b) return a; return b; }
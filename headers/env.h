@@ -0,0 +1,85 @@
+#ifndef ENV
+#define ENV
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Batched training environments, the interface of libforma. Each environment
+// is a headless game. One call steps every environment with an action each
+// and gives back a reward, a done flag and an observation for each, in flat
+// arrays indexed by environment. Environments are spread over a pool of
+// threads, and a game that ends starts over by itself, so the caller never
+// loops over them.
+
+// Actions, as bits of one int, the same as the game's player inputs. Any
+// combination can be held at once.
+enum env_actions
+{ ACTION_THRUST = 1, ACTION_LEFT = 2, ACTION_RIGHT = 4, ACTION_FIRE = 8 };
+
+// Floats in the observation of one environment. First the ship: its center
+// as a fraction of the screen's width and height, its velocity in pixels per
+// frame, the direction it faces as a unit vector in screen coordinates (y
+// down), its spin in radians per frame, and the laser cooldown as a fraction
+// of the longest. Then the ENV_ROCKS rocks nearest the ship, nearest first:
+// the offset of each center from the ship's, and its radius, as fractions of
+// the screen's width, and its velocity in pixels per frame. Missing rocks are
+// all zeros.
+#define ENV_ROCKS 8
+#define ENV_SHIP_OBS 8
+#define ENV_ROCK_OBS 5
+#define ENV_OBS (ENV_SHIP_OBS + ENV_ROCKS * ENV_ROCK_OBS)
+
+// libforma is built with hidden visibility; only what is declared here is
+// exported from it
+#ifdef __GNUC__
+#define FORMA_API __attribute__((visibility("default")))
+#else
+#define FORMA_API
+#endif // __GNUC__
+
+typedef struct Envs Envs;
+
+// Make n environments, the i-th playing its first game from seeds[i] and each
+// later one from a stream started at seeds[i], so runs are repeatable
+// whatever the number of threads. Every step covers step frames of play (1 is
+// the game's own pace), and a game is cut short after max_steps steps, or
+// never if it is 0. threads is as for the game's --threads: 0 for one per
+// processor, 1 to step everything on the calling thread. Returns NULL if n or
+// step is less than 1.
+FORMA_API Envs* openEnvs(int n, const uint64_t* seeds, int step,
+        long max_steps, int threads);
+
+// Number of environments
+FORMA_API int countEnvs(const Envs* e);
+
+// Write the observation of every environment as it stands into obs, which
+// holds n * ENV_OBS floats. For the first observations after openEnvs.
+FORMA_API void observeEnvs(const Envs* e, float* obs);
+
+// Step every environment with its own action from actions. For each, rewards
+// gets the score gained over the step and dones whether its game ended, by
+// the ship being destroyed or by running out of steps. A game that ended has
+// already been replaced by the next one, whose first observation is what obs
+// gets. obs holds n * ENV_OBS floats, or is NULL to skip observing.
+FORMA_API void stepEnvs(Envs* e, const int* actions, float* rewards,
+        bool* dones, float* obs);
+
+// Snapshots of one environment, for bots that search ahead by branching from
+// the middle of a game. A snapshot holds the game, how many steps it has
+// run and where the environment's seed stream is, so a restored environment
+// plays on, and starts its next games, exactly as the saved one would have.
+// envSnapshotSize is the most bytes a snapshot of environment i can take as
+// it stands, and buf must hold that many. saveEnv writes at most that many
+// and returns the bytes written, which are all a caller needs to keep.
+// restoreEnv makes environment i the one saved in buf, which may come from
+// any environment of any Envs with the same step, and returns false if buf
+// isn't a snapshot.
+FORMA_API size_t envSnapshotSize(const Envs* e, int i);
+FORMA_API size_t saveEnv(const Envs* e, int i, unsigned char* buf);
+FORMA_API bool restoreEnv(Envs* e, int i, const unsigned char* buf);
+
+// Stop the threads and free every environment
+FORMA_API void closeEnvs(Envs* e);
+
+#endif // ENV
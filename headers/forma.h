@@ -16,10 +16,54 @@
 #include <stdbool.h>
 #include <sys/time.h>
 
+#include "pack.h"
+
+// Most bounding boxes any sprite has
+#define MAX_BB 5
+
+// Size and bounding boxes shared by every sprite of one type, never modified
+// once the game has loaded. Boxes are given relative to the top left of the
+// sprite; centers and half extents are relative to the sprite's center, which
+// is the point it rotates about. A circle of radius about the center encloses
+// every box at any rotation; one of inner lies inside the boxes, or inner is
+// negative if the center is outside them. Both allow for hitbox corners being
+// truncated to whole pixels.
+typedef struct Shape
+{
+    int w;
+    int h;
+    int nbb;
+    SDL_Rect bb[MAX_BB];
+    double cx[MAX_BB];
+    double cy[MAX_BB];
+    double hw[MAX_BB];
+    double hh[MAX_BB];
+    double radius;
+    double inner;
+}
+Shape;
+
+// World-space corners of every bounding box of a sprite, the center they are
+// rotated about, the radii of its shape, and the axis aligned box enclosing
+// all of them. Refreshed once per frame after the sprite moves.
+typedef struct Hitbox
+{
+    int n;
+    double corners[MAX_BB][8];
+    double cx;
+    double cy;
+    double r;
+    double inner;
+    double x0;
+    double y0;
+    double x1;
+    double y1;
+}
+Hitbox;
+
 typedef struct Sprite
 {
     int id;
-    SDL_Texture* t;
     int w;
     int h;
     double x;
@@ -28,17 +72,161 @@ typedef struct Sprite
     double dx;
     double dy;
     double omega;
-    SDL_Rect* bb;
-    int nbb;
+    const Shape* shape;
+    Hitbox hb;
+
+    // Position before the last step, for drawing between steps
+    double px;
+    double py;
+    double ptheta;
 }
 Sprite;
 
-struct SpriteList
+// Every printable character of a font, rasterized once into one texture.
+// Glyph i spans columns [x[i], x[i + 1]) of the texture.
+typedef struct GlyphAtlas
+{
+    SDL_Texture* t;
+    int h;
+    int x[NUM_GLYPHS + 1];
+}
+GlyphAtlas;
+
+// Triangles sharing one texture (or none, for plain colored shapes), collected
+// while a frame is rendered and drawn with a single SDL_RenderGeometry call.
+// tw and th are the texture size, to turn pixel coordinates into UVs.
+typedef struct Batch
+{
+    SDL_Texture* t;
+    int tw;
+    int th;
+    SDL_Vertex* v;
+    int n;
+    int cap;
+}
+Batch;
+
+// Sound effects asked for by one step of the game, as a count per effect.
+// The game only ever adds to the queue; whatever plays it empties it.
+typedef struct SfxQueue
 {
-	struct SpriteList* prev;
-	struct SpriteList* next;
-	Sprite* sprite;
-};
-typedef struct SpriteList SpriteList;
+    int plays[NUM_SFX];
+}
+SfxQueue;
+
+// Mixer channels of the sound effects. Each effect has its own run of
+// channels, used in turn, so a new play takes over the oldest one once they
+// are all busy. Thrust loops on a channel of its own while held.
+typedef struct Voices
+{
+    int first[NUM_SFX];
+    int next[NUM_SFX];
+    bool looping;
+}
+Voices;
+
+// Window, renderer, fonts, textures and audio of an interactive game. Loaded
+// once and only read while the game runs, apart from the voices, which the
+// simulation thread owns; headless games have none.
+typedef struct Media
+{
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    TTF_Font* font;
+    GlyphAtlas atlas;
+    Batch batches[NUM_BATCHES];
+    Mix_Music* music;
+    Mix_Chunk* sfx[NUM_SFX];
+    Voices voices;
+    Pack pack;
+    SDL_Texture* textures[NUM_SPRITES];
+    SDL_Texture* aux_textures[NUM_AUX_TEXTURES];
+    bool debug;
+    bool vsync;
+}
+Media;
+
+// Pool of sprites kept as parallel arrays, one slot per sprite. Removed slots
+// go on a free list and are handed out again before the pool grows, so nothing
+// is allocated per frame once the pool has reached its peak size. Slots in
+// [0, top) have been used at least once; alive tells which are in use now.
+typedef struct SpritePool
+{
+    int cap;
+    int top;
+    int n;
+    int nfree;
+    int* free;
+    bool* alive;
+
+    // Live sprites of each type
+    int count[NUM_SPRITES];
+
+    // Motion, updated every frame
+    double* x;
+    double* y;
+    double* dx;
+    double* dy;
+    double* theta;
+    double* omega;
+
+    // Position before the last step, for drawing between steps
+    double* px;
+    double* py;
+    double* ptheta;
+
+    // Shape
+    int* id;
+    int* w;
+    int* h;
+    const Shape** shape;
+    Hitbox* hb;
+
+    // Per-slot scratch flags for passes over the pool
+    bool* mark;
+}
+SpritePool;
+
+// Everything needed to draw one simulation step: the HUD, and the ship and
+// every live sprite with where they were a step before. Hitboxes are only
+// copied for the debug overlay.
+typedef struct Frame
+{
+    long long score;
+    int laser_cooldown;
+    bool thrust;
+    Uint64 time;
+    Sprite ship;
+    Sprite* sprites;
+    int n;
+    int cap;
+}
+Frame;
+
+// Lock-free triple buffer passing frames from the simulation thread to the
+// render thread. Each side owns one frame; the third is swapped between them
+// through mid, whose FRAME_FRESH bit says the writer has published a frame the
+// reader hasn't taken yet. Neither side ever waits for the other.
+#define FRAME_FRESH 4
+typedef struct TripleBuffer
+{
+    Frame frames[3];
+    int back;
+    int front;
+    int mid;
+}
+TripleBuffer;
+
+// Fixed memory ring of the most recent snapshots of a game. Every snapshot
+// gets a slot of the same size; one that doesn't fit is not kept.
+typedef struct Rewind
+{
+    unsigned char* data;
+    size_t slot;
+    int cap;
+    int head;
+    int count;
+}
+Rewind;
 
 #endif // FORMA
@@ -0,0 +1,135 @@
+#ifndef GAME
+#define GAME
+
+#include "constants.h"
+#include "forma.h"
+#include "profile.h"
+#include "workers.h"
+
+// The simulation: game state and the rules that advance it a step at a time.
+// Nothing here draws, plays sound or reads input, so it builds and runs
+// without SDL, and is what libforma is made of.
+
+// Colliding pairs of slots found by one chunk of the narrow phase, as (i, j)
+// in the order a serial scan meets them. ship is the first slot of the chunk
+// whose sprite hits the ship, or -1.
+typedef struct HitList
+{
+    int* pairs;
+    int n;
+    int cap;
+    int ship;
+    long counts[NUM_COUNTERS];
+}
+HitList;
+
+// Uniform grid used as the broad phase of collision detection. Cells are at
+// least as wide as the largest sprite, so two sprites that touch always sit in
+// the same or neighbouring cells. Rocks and lasers are kept in separate lists
+// of cells, rocks first, so lasers are only ever looked up against rocks.
+// Each thread searching the grid has its own candidate buffer, and each chunk
+// of the narrow phase its own hit list. Buffers only grow, and are reused
+// each frame.
+typedef struct Grid
+{
+    double cell;
+    double margin;
+    int cols;
+    int rows;
+    int* start;
+    int* fill;
+    int cap;
+    int* cell_of;
+    int* items;
+    int** cand;
+    int ncand;
+    HitList* hits;
+    int nhits;
+}
+Grid;
+
+// Game state is captured by this data structure. Games share nothing but
+// the shape templates, which are read only, so separate games can be updated
+// on separate threads at once.
+typedef struct State
+{
+    long long score;
+    uint64_t seed;
+    Rng rng;
+    Sprite ship;
+    int laser_cooldown;
+    bool thrust;
+    SpritePool sprites;
+    Grid grid;
+
+    // Size of the world. Sprites spawn at its edges and despawn well outside
+    // it, and the ship wraps around it. The screen, except in benchmarks.
+    int width;
+    int height;
+
+    // Frames of motion each update covers. Above 1, collisions are swept
+    // over the whole step so nothing passes through anything in between.
+    int step;
+
+    // Rocks still get tested against the ship but can't end the game, for
+    // benchmarks that have to run their full length
+    bool invincible;
+
+    // No asteroids spawn, for benchmarks that hold a fixed number of rocks
+    bool no_spawns;
+
+    // Sound effects asked for this step. Only an interactive game plays
+    // them; otherwise nothing reads the queue.
+    SfxQueue sfx;
+
+    // Where frame timings go, or NULL when not profiling
+    Profile* prof;
+
+    // Threads to share collision detection with, or NULL to run it alone
+    Workers* workers;
+}
+State;
+
+// Hitbox templates, one per sprite type
+extern Shape shapes[NUM_SPRITES];
+
+// Compute the local-space data of every hitbox template. Must run once before
+// any game is started.
+void loadShapes(void);
+
+// Make a new sprite, ready to be added to a game
+Sprite loadSprite(int id, double x, double y);
+
+// Refresh the cached hitbox of a sprite after it has moved
+void updateSpriteHitbox(Sprite* s);
+
+// Fill a free slot of a sprite pool and return it, or free one
+int addSprite(SpritePool* p, Sprite s);
+void removeSprite(SpritePool* p, int i);
+
+// Asteroids off the edge of the screen heading in, breaking an asteroid into
+// fragments, and firing a laser from the ship
+Sprite spawnAsteroid(State* st);
+void breakAsteroid(State* st, const Sprite* a);
+void fireLaser(State* st);
+
+// Set up a fresh game whose every random number is drawn from seed, or free
+// one
+void newGame(State* st, uint64_t seed);
+void unloadGame(State* st);
+
+// Snapshots of a game, as flat byte buffers meant for keeping in memory.
+// snapshotSize is the most bytes a game with top pool slots in use can take,
+// and saveSnapshot writes at most that many for st and returns the bytes
+// written. restoreSnapshot makes st the saved game, which plays on exactly as
+// the saved one would have, keeping st's own step, world, sound, profile and
+// scratch buffers. It returns false if buf isn't a snapshot.
+size_t snapshotSize(int top);
+size_t saveSnapshot(const State* st, unsigned char* buf);
+bool restoreSnapshot(State* st, const unsigned char* buf);
+
+// Advance a game by one step of player input, a mask of INPUT_* bits.
+// Returns true if the ship was destroyed.
+bool updateGame(State* st, int input);
+
+#endif // GAME
@@ -4,11 +4,12 @@ check the game independently of SDL.
 */
 
 #include <stdlib.h>
+#include "constants.h"
 
 // Values never used
 enum {
     SDL_INIT_VIDEO, SDL_INIT_AUDIO,
-    SDL_RENDERER_ACCELERATED,
+    SDL_RENDERER_ACCELERATED, SDL_RENDERER_PRESENTVSYNC,
     SDL_FLIP_NONE, SDL_QUIT, SDL_KEYDOWN,
     MIX_DEFAULT_FORMAT
 };
@@ -18,6 +19,7 @@ enum {
 #define SDL_SCANCODE_LEFT  1
 #define SDL_SCANCODE_RIGHT 1
 #define SDL_SCANCODE_SPACE 2
+#define SDL_SCANCODE_BACKSPACE 1
 
 // Only passed as pointers, never dereferenced; type could be anything
 typedef int SDL_Window;
@@ -27,25 +29,40 @@ typedef int SDL_Surface;
 typedef int TTF_Font;
 typedef int Mix_Music;
 typedef int Mix_Chunk;
+typedef int SDL_RWops;
 typedef int Uint8;
+typedef unsigned long long Uint64;
 
-// SDL_Event, SDL_Color, SDL_Rect are accessed directly by us,
+// SDL_Event, SDL_Color, SDL_Rect, SDL_Vertex are accessed directly by us,
 // so they need actual definitions
 typedef struct SSE { int sym; } SSE;
 typedef struct SE { SSE keysym; } SE;
 typedef struct SDL_Event { int type; SE key; } SDL_Event;
 typedef struct SDL_Rect { int x; int y; int w; int h; } SDL_Rect;
-typedef struct SDL_Color { int r; int g; int b; } SDL_Color;
+typedef struct SDL_Color { int r; int g; int b; int a; } SDL_Color;
+typedef struct SDL_FPoint { float x; float y; } SDL_FPoint;
+typedef struct SDL_Vertex { SDL_FPoint position; SDL_Color color; SDL_FPoint tex_coord; } SDL_Vertex;
 
 // The "keyboard" that the SDL_SCANCODEs index into.
 // These settings cause the ship to accelerate forward and shoot, but not turn
 static Uint8 spoofKeystate[3] = { 1, 0, 1 };
 
+// Spoofed clock. Every read is a step later than the last, so the fixed rate
+// loop always has a step due and games play out with no real time passing.
+// Read from the render and simulation threads alike.
+static Uint64 spoofCounter = 0;
+
 // 0 indicates success
 static inline int           SDL_Init(int a)                                                     { return 0; }
 static inline int           TTF_Init(void)                                                      { return 0; }
 static inline int           SDL_GetTicks(void)                                                  { return 0; }
+static inline Uint64        SDL_GetPerformanceFrequency(void)                                   { return 1000 * MAX_FPS; }
+static inline Uint64        SDL_GetPerformanceCounter(void)                                     { return __atomic_add_fetch(&spoofCounter, 1000, __ATOMIC_RELAXED); }
 static inline int           Mix_PlayChannel(int a, Mix_Chunk* b, int c)                         { return 0; }
+static inline int           TTF_SizeText(TTF_Font* a, const char* b, int* c, int* d)            { *c = 0; *d = 0; return 0; }
+static inline int           SDL_QueryTexture(SDL_Texture* a, void* b, void* c, int* d, int* e)  { *d = 1; *e = 1; return 0; }
+static inline int           SDL_RenderGeometry(SDL_Renderer* a, SDL_Texture* b,
+                                               const SDL_Vertex* c, int d, const int* e, int f) { return 0; }
 
 // SDL_PollEvent must return 0 and set the event type to
 // an integer value which is not SDL_KEYDOWN or SDL_QUIT.
@@ -66,6 +83,12 @@ static inline TTF_Font*     TTF_OpenFont(const char* a, int b)
 static inline Mix_Music*    Mix_LoadMUS(const char* a)                                          { return NULL; }
 static inline Mix_Chunk*    Mix_LoadWAV(const char* a)                                          { return NULL; }
 static inline SDL_Surface*  TTF_RenderText_Solid(TTF_Font* a, const char* b, SDL_Color c)       { return NULL; }
+static inline SDL_RWops*    SDL_RWFromFile(const char* a, const char* b)                        { return NULL; }
+static inline SDL_RWops*    SDL_RWFromConstMem(const void* a, int b)                            { return NULL; }
+static inline SDL_Surface*  SDL_LoadBMP_RW(SDL_RWops* a, int b)                                 { return NULL; }
+static inline TTF_Font*     TTF_OpenFontRW(SDL_RWops* a, int b, int c)                          { return NULL; }
+static inline Mix_Music*    Mix_LoadMUS_RW(SDL_RWops* a, int b)                                 { return NULL; }
+static inline Mix_Chunk*    Mix_LoadWAV_RW(SDL_RWops* a, int b)                                 { return NULL; }
 
 // No-op functions
 static inline void          SDL_Quit(void)                                                      {}
@@ -85,6 +108,7 @@ static inline void          Mix_VolumeMusic(int a)
 static inline void          Mix_PlayMusic(Mix_Music* a, int b)                                  {}
 static inline void          Mix_ExpireChannel(int a, int b)                                     {}
 static inline void          Mix_HaltChannel(int a)                                              {}
+static inline int           Mix_AllocateChannels(int a)                                         { return a; }
 static inline void          SDL_RenderClear(SDL_Renderer* a)                                    {}
 static inline void          SDL_RenderPresent(SDL_Renderer* a)                                  {}
 static inline void          SDL_RenderDrawLine(SDL_Renderer* a, int b, int c, int d, int e)     {}
@@ -0,0 +1,47 @@
+#ifndef PACK
+#define PACK
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Bundle the game looks for in the working directory before loose files
+#define PACK_FILE "assets.pack"
+
+// Longest asset name, including its terminating NUL
+#define PACK_NAME 64
+
+// Every asset of the game in one file, mapped into memory read only. Assets
+// are named by the path they would have as loose files, like
+// "audio/laser.wav", and sound effects are stored already converted to the
+// format the mixer plays.
+//
+// On disk: the 4 bytes "FPAK", then the version and the asset count as
+// little-endian 32-bit integers, then an index entry per asset of its name
+// (NUL padded to PACK_NAME bytes) and the offset and size of its data as
+// little-endian 64-bit integers. Data follows, each asset starting on a
+// PACK_ALIGN byte boundary.
+#define PACK_VERSION 1
+#define PACK_ALIGN 16
+#define PACK_HEADER 12
+#define PACK_ENTRY (PACK_NAME + 16)
+typedef struct Pack
+{
+    const unsigned char* data;
+    size_t size;
+    uint32_t count;
+}
+Pack;
+
+// Map a bundle into memory. Returns false, leaving the pack empty, if the
+// file can't be mapped or isn't a valid bundle.
+bool openPack(Pack* p, const char* path);
+
+// Data of the asset with the given name and its size in bytes, or NULL if
+// the bundle doesn't have it. The data lives until the pack is closed.
+const void* findInPack(const Pack* p, const char* name, size_t* size);
+
+// Unmap a bundle
+void closePack(Pack* p);
+
+#endif // PACK
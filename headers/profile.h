@@ -0,0 +1,77 @@
+#ifndef PROFILER
+#define PROFILER
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Timed phases of a frame, in the order they run
+#define NUM_PHASES 9
+enum phases
+{
+    PHASE_SHIP, PHASE_MOVE, PHASE_COLLIDE, PHASE_LASERS, PHASE_DESPAWN,
+    PHASE_SPAWN, PHASE_DRAW_SPRITES, PHASE_DRAW_HUD, PHASE_FLUSH
+};
+
+// Events counted over a frame
+#define NUM_COUNTERS 5
+enum counters
+{ COUNT_PAIRS, COUNT_SAT, COUNT_CIRCLE_REJECTS, COUNT_SPAWNS, COUNT_DESPAWNS };
+
+// Per-frame timings and counters, written out as one sample per frame. The
+// output is a Chrome trace (chrome://tracing, Perfetto) unless the file name
+// ends in .csv, in which case it is one CSV row per frame. Simulation and
+// drawing phases may be timed from different threads; the trace shows
+// drawing on a track of its own. Phase times and counters are only updated
+// under the lock, so both threads can record at once. Each phase's time is
+// also totalled over all frames so far.
+typedef struct Profile
+{
+    pthread_mutex_t lock;
+    FILE* out;
+    bool csv;
+    long frame;
+    double origin;
+    double frame_start;
+    double phase_start[NUM_PHASES];
+    double elapsed[NUM_PHASES];
+    double totals[NUM_PHASES];
+    long counts[NUM_COUNTERS];
+}
+Profile;
+
+// Timers and counters compile away unless built with -D PROFILE. Every call
+// takes the Profile to record into, which may be NULL.
+#ifdef PROFILE
+#define PROFILE_BEGIN(p, phase)  do { if(p) beginPhase(p, phase); } while(0)
+#define PROFILE_END(p, phase)    do { if(p) endPhase(p, phase); } while(0)
+#define PROFILE_COUNT(p, c, n)   do { if(p) countEvents(p, c, n); } while(0)
+#define PROFILE_FRAME(p)         do { if(p) endFrame(p); } while(0)
+#else
+#define PROFILE_BEGIN(p, phase)  ((void) 0)
+#define PROFILE_END(p, phase)    ((void) 0)
+#define PROFILE_COUNT(p, c, n)   ((void) 0)
+#define PROFILE_FRAME(p)         ((void) 0)
+#endif // PROFILE
+
+// Open a profile writing to path, or return NULL if it can't be created. A
+// NULL path writes nothing and only keeps the totals.
+Profile* openProfile(const char* path);
+
+// Name of a phase, as it appears in the output
+const char* phaseName(int phase);
+
+// Time a phase of the current frame
+void beginPhase(Profile* p, int phase);
+void endPhase(Profile* p, int phase);
+
+// Add n to a counter of the current frame
+void countEvents(Profile* p, int counter, long n);
+
+// Write out the current frame's sample and start the next frame
+void endFrame(Profile* p);
+
+// Finish the output file and free the profile
+void closeProfile(Profile* p);
+
+#endif // PROFILER
@@ -0,0 +1,46 @@
+#ifndef REPLAY
+#define REPLAY
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// A game's seed and the input bits of every frame it ran for. Input is kept
+// run-length encoded, one byte per run of up to 16 equal frames: the input
+// bits in the low nibble and the run length minus one in the high nibble.
+//
+// On disk: the 4 bytes "FRMA", a version byte, the seed and the frame count
+// as little-endian 64-bit integers, then the runs.
+typedef struct Recording
+{
+    uint64_t seed;
+    long frames;
+    unsigned char* runs;
+    long n;
+    long cap;
+
+    // Read position, for playing a recording back
+    long pos;
+    int left;
+}
+Recording;
+
+// Start an empty recording of a game with the given seed
+void startRecording(Recording* r, uint64_t seed);
+
+// Add one frame of input to the end of a recording
+void recordInput(Recording* r, int input);
+
+// Write a recording to a file. Returns false if it can't be written.
+bool saveRecording(const Recording* r, const char* path);
+
+// Read a recording from a file, ready to play back from the first frame.
+// Returns false if the file can't be read or isn't a recording.
+bool loadRecording(Recording* r, const char* path);
+
+// Input of the next frame of a recording, or -1 once all have been played
+int replayInput(Recording* r);
+
+// Free a recording's runs
+void freeRecording(Recording* r);
+
+#endif // REPLAY
@@ -0,0 +1,27 @@
+#ifndef SAT
+#define SAT
+
+#include "constants.h"
+#include "forma.h"
+
+// Separating axis test between every box of one hitbox and every box of
+// another, on their cached corners. True if any pair of boxes overlaps.
+//
+// satScalar is the reference, testing one box pair and one corner at a time.
+// satSimd splits each box into x and y lanes once, then projects all four
+// corners of a box onto an axis at once with no branches, using AVX or SSE2
+// where the compiler targets them and satScalar otherwise. Both give the
+// same answer for every input; satOverlap is whichever is faster here.
+bool satScalar(const Hitbox* h1, const Hitbox* h2);
+bool satSimd(const Hitbox* h1, const Hitbox* h2);
+
+// Instruction set satSimd was built for: "avx", "sse2" or "scalar"
+const char* satKernel(void);
+
+#if (defined(__AVX__) || defined(__SSE2__)) && !defined(CBMC)
+#define satOverlap satSimd
+#else
+#define satOverlap satScalar
+#endif
+
+#endif // SAT
@@ -0,0 +1,54 @@
+#ifndef WORKERS
+#define WORKERS
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// A task is run once for every index of a batch, by whichever worker gets to
+// it first. worker is in [0, n) and can be used to pick per-worker scratch.
+typedef void (*Task)(void* arg, int index, int worker);
+
+// Indices of a batch a worker has yet to run, [lo, hi). Owners take from the
+// front and thieves take from the back.
+typedef struct Range
+{
+    pthread_mutex_t lock;
+    int lo;
+    int hi;
+    long steals;
+}
+Range;
+
+// Fixed pool of threads running batches of independent tasks. The thread that
+// calls runTasks joins in as worker 0, so a pool of n has n - 1 threads.
+typedef struct Workers
+{
+    int n;
+    pthread_t* threads;
+    Range* ranges;
+
+    // Current batch, and how many threads are still working on it
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    long batch;
+    int busy;
+    bool quit;
+    Task fn;
+    void* arg;
+}
+Workers;
+
+// Start a pool of n workers, or as many as there are processors if n < 1
+Workers* startWorkers(int n);
+
+// Run fn for every index in [0, count) and return once all of them are done
+void runTasks(Workers* w, int count, Task fn, void* arg);
+
+// Total number of ranges stolen since the pool started
+long countSteals(const Workers* w);
+
+// Stop every thread and free the pool
+void stopWorkers(Workers* w);
+
+#endif // WORKERS
@@ -0,0 +1,200 @@
+#include "../headers/env.h"
+#include "../headers/game.h"
+
+// Environments per task handed to the worker threads
+#define ENV_CHUNK 16
+
+// Longest laser cooldown, at the start of a game
+#define MAX_COOLDOWN 50
+
+// Start of a snapshot of an environment, followed by a snapshot of its game
+typedef struct EnvHeader
+{
+	Rng seeds;
+	long steps;
+}
+EnvHeader;
+
+// One environment: its game, the stream its later games are seeded from, and
+// how many steps the current game has run
+typedef struct Env
+{
+	State st;
+	Rng seeds;
+	long steps;
+}
+Env;
+
+struct Envs
+{
+	int n;
+	int step;
+	long max_steps;
+	Env* envs;
+	Workers* workers;
+
+	// Arguments of the step in progress, for the tasks
+	const int* actions;
+	float* rewards;
+	bool* dones;
+	float* obs;
+};
+
+// The shape templates are shared by every game in the process, so they are
+// only computed once, whoever opens environments first
+static pthread_once_t shapes_once = PTHREAD_ONCE_INIT;
+
+// Start the next game of an environment
+static void startGame(Env* env, uint64_t seed, int step)
+{
+	newGame(&env->st, seed);
+	env->st.step = step;
+	env->steps = 0;
+}
+
+// Write the observation of one game into obs[ENV_OBS]
+static void observe(const State* st, float* obs)
+{
+	const Sprite* s = &st->ship;
+	const Hitbox* hb = &s->hb;
+	obs[0] = hb->cx / SCREEN_WIDTH;
+	obs[1] = hb->cy / SCREEN_HEIGHT;
+	obs[2] = s->dx;
+	obs[3] = s->dy;
+	obs[4] = cos(s->theta);
+	obs[5] = -sin(s->theta);
+	obs[6] = s->omega;
+	obs[7] = (float) st->laser_cooldown / MAX_COOLDOWN;
+
+	// Nearest rocks by insertion into a short sorted list
+	const SpritePool* p = &st->sprites;
+	int near[ENV_ROCKS];
+	double dist[ENV_ROCKS];
+	int n = 0;
+	for(int i = 0; i < p->top; i++) {
+		if(!p->alive[i] || p->id[i] == LASER) continue;
+		double dx = p->hb[i].cx - hb->cx;
+		double dy = p->hb[i].cy - hb->cy;
+		double d = dx * dx + dy * dy;
+		if(n == ENV_ROCKS && d >= dist[n - 1]) continue;
+		int k = n < ENV_ROCKS ? n++ : n - 1;
+		for(; k > 0 && dist[k - 1] > d; k--) {
+			near[k] = near[k - 1];
+			dist[k] = dist[k - 1];
+		}
+		near[k] = i;
+		dist[k] = d;
+	}
+
+	float* rock = obs + ENV_SHIP_OBS;
+	memset(rock, 0, sizeof(float) * ENV_ROCKS * ENV_ROCK_OBS);
+	for(int k = 0; k < n; k++, rock += ENV_ROCK_OBS) {
+		int i = near[k];
+		rock[0] = (p->hb[i].cx - hb->cx) / SCREEN_WIDTH;
+		rock[1] = (p->hb[i].cy - hb->cy) / SCREEN_WIDTH;
+		rock[2] = p->dx[i];
+		rock[3] = p->dy[i];
+		rock[4] = p->hb[i].r / SCREEN_WIDTH;
+	}
+}
+
+// Step one chunk of environments, starting the next game of any that end.
+// Chunks run on separate threads, which separate games allow (see State).
+static void stepChunk(void* arg, int chunk, int worker)
+{
+	Envs* e = arg;
+	int end = min((chunk + 1) * ENV_CHUNK, e->n);
+	for(int i = chunk * ENV_CHUNK; i < end; i++) {
+		Env* env = &e->envs[i];
+		long long score = env->st.score;
+
+		// Actions are the game's own input bits
+		bool dead = updateGame(&env->st, e->actions[i]);
+		env->steps++;
+		e->rewards[i] = env->st.score - score;
+		e->dones[i] = dead || (e->max_steps && env->steps >= e->max_steps);
+		if(e->dones[i]) {
+			unloadGame(&env->st);
+			startGame(env, nextRng(&env->seeds), e->step);
+		}
+		if(e->obs) observe(&env->st, e->obs + (size_t) i * ENV_OBS);
+	}
+}
+
+Envs* openEnvs(int n, const uint64_t* seeds, int step, long max_steps,
+		int threads)
+{
+	if(n < 1 || step < 1) return NULL;
+	pthread_once(&shapes_once, loadShapes);
+
+	Envs* e = calloc(1, sizeof(Envs));
+	e->n = n;
+	e->step = step;
+	e->max_steps = max_steps;
+	e->envs = malloc(sizeof(Env) * n);
+	for(int i = 0; i < n; i++) {
+		seedRng(&e->envs[i].seeds, seeds[i]);
+		startGame(&e->envs[i], seeds[i], step);
+	}
+	e->workers = startWorkers(threads);
+	return e;
+}
+
+int countEnvs(const Envs* e)
+{
+	return e->n;
+}
+
+void observeEnvs(const Envs* e, float* obs)
+{
+	for(int i = 0; i < e->n; i++) {
+		observe(&e->envs[i].st, obs + (size_t) i * ENV_OBS);
+	}
+}
+
+void stepEnvs(Envs* e, const int* actions, float* rewards, bool* dones,
+		float* obs)
+{
+	e->actions = actions;
+	e->rewards = rewards;
+	e->dones = dones;
+	e->obs = obs;
+	int chunks = (e->n + ENV_CHUNK - 1) / ENV_CHUNK;
+	if(e->workers->n > 1) runTasks(e->workers, chunks, stepChunk, e);
+	else for(int c = 0; c < chunks; c++) stepChunk(e, c, 0);
+}
+
+size_t envSnapshotSize(const Envs* e, int i)
+{
+	return sizeof(EnvHeader) + snapshotSize(e->envs[i].st.sprites.top);
+}
+
+size_t saveEnv(const Envs* e, int i, unsigned char* buf)
+{
+	const Env* env = &e->envs[i];
+	EnvHeader h;
+	memset(&h, 0, sizeof(h));
+	h.seeds = env->seeds;
+	h.steps = env->steps;
+	memcpy(buf, &h, sizeof(h));
+	return sizeof(h) + saveSnapshot(&env->st, buf + sizeof(h));
+}
+
+bool restoreEnv(Envs* e, int i, const unsigned char* buf)
+{
+	Env* env = &e->envs[i];
+	if(!restoreSnapshot(&env->st, buf + sizeof(EnvHeader))) return false;
+	EnvHeader h;
+	memcpy(&h, buf, sizeof(h));
+	env->seeds = h.seeds;
+	env->steps = h.steps;
+	return true;
+}
+
+void closeEnvs(Envs* e)
+{
+	for(int i = 0; i < e->n; i++) unloadGame(&e->envs[i].st);
+	stopWorkers(e->workers);
+	free(e->envs);
+	free(e);
+}
@@ -0,0 +1,1233 @@
+#include "../headers/game.h"
+#include "../headers/sat.h"
+
+// Slots per chunk of the narrow phase, and the fewest slots worth splitting
+// across worker threads
+#define COLLIDE_CHUNK 64
+#ifndef PARALLEL_MIN
+#define PARALLEL_MIN 512
+#endif // PARALLEL_MIN
+
+// Start of a snapshot of a State. Snapshots are flat byte buffers in native
+// byte order, meant for keeping in memory: this header, then for each of the
+// top pool slots its alive flag, type id and motion, then the free list.
+// Sprite types are stored as ids, and hitboxes are rebuilt on restore.
+#define SNAPSHOT_MAGIC 0x414D5246
+typedef struct SnapshotHeader
+{
+	uint32_t magic;
+	uint32_t size;
+	long long score;
+	uint64_t seed;
+	Rng rng;
+	double ship[9];
+	int laser_cooldown;
+	int thrust;
+	int top;
+	int n;
+	int nfree;
+}
+SnapshotHeader;
+
+// Most bytes of snapshot each pool slot takes: alive, id, 9 motion values
+// and possibly a free list entry
+#define SNAPSHOT_SLOT \
+	(sizeof(bool) + sizeof(int) + 9 * sizeof(double) + sizeof(int))
+
+// Hitbox templates, one per sprite type. Derived fields are filled in by
+// loadShapes() before any sprite is made.
+Shape shapes[NUM_SPRITES] = {
+	[ASTER]    = { 84, 83, 5, { { 41,  1, 29, 71 }, {  1, 18, 80, 23 },
+	                            { 16, 10, 34, 71 }, {  7, 42, 76, 15 },
+	                            { 73, 54,  6, 15 } } },
+	[FRAGMENT] = { 45, 44, 4, { {  5, 13, 33, 19 }, {  1, 33, 38,  8 },
+	                            { 37,  2,  7, 19 }, { 19,  9, 19,  5 } } },
+	[LASER]    = {  2, 12, 1, { {  0,  0,  2, 12 } } },
+	[SHIP]     = { 20, 20, 2, { {  2,  2,  7, 16 }, {  4,  7, 16,  6 } } }
+};
+
+typedef struct Circle {
+	double x;
+	double y;
+	double r;
+} Circle;
+
+// Ask for a sound effect to be played at the end of the step
+static void queueSfx(State* st, int sfx_id)
+{
+	st->sfx.plays[sfx_id]++;
+}
+
+// Compute the local-space data of every hitbox template from its boxes
+void loadShapes(void)
+{
+	// Truncating a corner to whole pixels moves it less than a pixel each way
+	double slack = sqrt(2.0);
+
+	for(int id = 0; id < NUM_SPRITES; id++) {
+		Shape* sh = &shapes[id];
+		sh->radius = 0;
+		sh->inner = -1;
+		for(int i = 0; i < sh->nbb; i++) {
+			SDL_Rect b = sh->bb[i];
+			sh->hw[i] = b.w / 2.0;
+			sh->hh[i] = b.h / 2.0;
+			sh->cx[i] = b.x + sh->hw[i] - sh->w / 2.0;
+			sh->cy[i] = b.y + sh->hh[i] - sh->h / 2.0;
+			double far_x = fabs(sh->cx[i]) + sh->hw[i];
+			double far_y = fabs(sh->cy[i]) + sh->hh[i];
+			sh->radius = max(sh->radius,
+					sqrt(far_x * far_x + far_y * far_y) + slack);
+
+			// Distance from the center to the nearest edge of a box around it
+			double near_x = sh->hw[i] - fabs(sh->cx[i]);
+			double near_y = sh->hh[i] - fabs(sh->cy[i]);
+			if(near_x > 0 && near_y > 0) {
+				sh->inner = max(sh->inner, min(near_x, near_y) - slack);
+			}
+		}
+	}
+}
+
+// Make a new sprite, ready to be added to the game
+Sprite loadSprite(int id, double x, double y)
+{
+	Sprite s;
+	s.id = id;
+	s.shape = &shapes[id];
+	s.w = s.shape->w;
+	s.h = s.shape->h;
+	s.x = x;
+	s.y = y;
+	s.theta = M_PI_2;
+	s.dx = 0;
+	s.dy = 0;
+	s.omega = 0;
+	s.px = x;
+	s.py = y;
+	s.ptheta = s.theta;
+	return s;
+}
+
+// Rotate the bounding boxes of a sprite into world space, caching the corners
+// of each box and the axis aligned box around all of them
+static void updateHitbox(Hitbox* hb, const Shape* sh, double x, double y,
+		double theta)
+{
+	const SDL_Rect* bbs = sh->bb;
+	int nbb = sh->nbb;
+	int w = sh->w;
+	int h = sh->h;
+	double c = cos(theta);
+	double sn = sin(theta);
+
+	// Center around which each point is rotated
+	double bb_c[2] = { x + w / 2.0, y + h / 2.0 };
+
+	hb->n = nbb;
+	hb->cx = bb_c[0];
+	hb->cy = bb_c[1];
+	hb->r = sh->radius;
+	hb->inner = sh->inner;
+	hb->x0 = hb->y0 = INFINITY;
+	hb->x1 = hb->y1 = -INFINITY;
+	for(int i = 0; i < nbb; i++) {
+
+		// Positions of the points on the rectangle in space
+		int x1 = bbs[i].x + x;
+		int y1 = bbs[i].y + y;
+		int bb[4][2] = { { x1, y1 }
+		               , { x1 + bbs[i].w, y1 }
+		               , { x1, y1 + bbs[i].h }
+		               , { x1 + bbs[i].w, y1 + bbs[i].h } };
+
+		// Rotated positions for every point
+		double* r_bb = hb->corners[i];
+		for(int k = 0; k < 4; k++) {
+			r_bb[k * 2 + 0] = bb_c[0]
+			                + c * (bb[k][0] - bb_c[0])
+			                - sn * (bb_c[1] - bb[k][1]);
+			r_bb[k * 2 + 1] = bb_c[1]
+			                - sn * (bb[k][0] - bb_c[0])
+			                - c * (bb_c[1] - bb[k][1]);
+			hb->x0 = min(hb->x0, r_bb[k * 2 + 0]);
+			hb->y0 = min(hb->y0, r_bb[k * 2 + 1]);
+			hb->x1 = max(hb->x1, r_bb[k * 2 + 0]);
+			hb->y1 = max(hb->y1, r_bb[k * 2 + 1]);
+		}
+	}
+}
+
+// Refresh the cached hitbox of a sprite after it has moved
+void updateSpriteHitbox(Sprite* s)
+{
+	updateHitbox(&s->hb, s->shape, s->x, s->y, s->theta);
+}
+
+// Refresh the cached hitbox of the sprite in a pool slot
+static void updatePoolHitbox(SpritePool* p, int i)
+{
+	updateHitbox(&p->hb[i], p->shape[i], p->x[i], p->y[i], p->theta[i]);
+}
+
+// Double the number of slots in a sprite pool
+static void growPool(SpritePool* p)
+{
+	p->cap = p->cap ? p->cap * 2 : 64;
+	p->free  = realloc(p->free,  sizeof(int) * p->cap);
+	p->alive = realloc(p->alive, sizeof(bool) * p->cap);
+	p->x     = realloc(p->x,     sizeof(double) * p->cap);
+	p->y     = realloc(p->y,     sizeof(double) * p->cap);
+	p->dx    = realloc(p->dx,    sizeof(double) * p->cap);
+	p->dy    = realloc(p->dy,    sizeof(double) * p->cap);
+	p->theta = realloc(p->theta, sizeof(double) * p->cap);
+	p->omega = realloc(p->omega, sizeof(double) * p->cap);
+	p->px    = realloc(p->px,    sizeof(double) * p->cap);
+	p->py    = realloc(p->py,    sizeof(double) * p->cap);
+	p->ptheta = realloc(p->ptheta, sizeof(double) * p->cap);
+	p->id    = realloc(p->id,    sizeof(int) * p->cap);
+	p->w     = realloc(p->w,     sizeof(int) * p->cap);
+	p->h     = realloc(p->h,     sizeof(int) * p->cap);
+	p->shape = realloc(p->shape, sizeof(Shape*) * p->cap);
+	p->hb    = realloc(p->hb,    sizeof(Hitbox) * p->cap);
+	p->mark  = realloc(p->mark,  sizeof(bool) * p->cap);
+}
+
+// Copy a new sprite into a free slot of the pool, recycling a removed slot if
+// there is one. Returns the slot.
+int addSprite(SpritePool* p, Sprite s)
+{
+	int i;
+	if(p->nfree > 0) i = p->free[--p->nfree];
+	else {
+		if(p->top == p->cap) growPool(p);
+		i = p->top++;
+	}
+	p->alive[i] = true;
+	p->x[i] = s.x;
+	p->y[i] = s.y;
+	p->dx[i] = s.dx;
+	p->dy[i] = s.dy;
+	p->theta[i] = s.theta;
+	p->omega[i] = s.omega;
+	p->px[i] = s.x;
+	p->py[i] = s.y;
+	p->ptheta[i] = s.theta;
+	p->id[i] = s.id;
+	p->w[i] = s.w;
+	p->h[i] = s.h;
+	p->shape[i] = s.shape;
+	updatePoolHitbox(p, i);
+	p->n++;
+	p->count[s.id]++;
+	return i;
+}
+
+// Copy the sprite in a pool slot out of the pool
+static Sprite getSprite(const SpritePool* p, int i)
+{
+	Sprite s = loadSprite(p->id[i], p->x[i], p->y[i]);
+	s.dx = p->dx[i];
+	s.dy = p->dy[i];
+	s.theta = p->theta[i];
+	s.omega = p->omega[i];
+	s.hb = p->hb[i];
+	return s;
+}
+
+// Remove the sprite in a pool slot and put the slot on the free list. The
+// slot stops moving, so dead slots stay put in the per-frame passes.
+void removeSprite(SpritePool* p, int i)
+{
+	p->alive[i] = false;
+	p->dx[i] = 0;
+	p->dy[i] = 0;
+	p->omega[i] = 0;
+	p->free[p->nfree++] = i;
+	p->n--;
+	p->count[p->id[i]]--;
+}
+
+// Create a new asteroid at a random position off the edge of the screen,
+// with a random inward velocity
+Sprite spawnAsteroid(State* st)
+{
+	// Width and height of the asteroid
+	int a_w = shapes[ASTER].w;
+	int a_h = shapes[ASTER].h;
+
+	// Weight the chances towards spawning an asteroid on the longer edge, to
+	// even out the distribution of where they appear across the perimeter
+	double ratio = (double) st->width / (double) st->height;
+	double weighted_chance = ratio * 0.5;
+
+	// Values to fill
+	Rng* rng = &st->rng;
+	double x = 0.0;
+	double y = 0.0;
+	double dx = min(((getRand(rng) * 2.5) + 0.5) * (0.5 + st->score / 16000.0), 3);
+	double dy = min(((getRand(rng) * 2.5) + 0.5) * (0.5 + st->score / 16000.0), 3);
+
+	// From the top of the screen, with downward velocity
+	double where = getRand(rng);
+	if(where < weighted_chance / 2) {
+		x = getRand(rng) * (st->width - a_w);
+		y = 0 - a_h;
+		dx /= 2;
+	}
+
+	// From the bottom of the screen, with upward velocity
+	else if(where < weighted_chance) {
+		x = getRand(rng) * (st->width - a_w);
+		y = st->height;
+		dx /= 2;
+		dy *= -1;
+	}
+
+	// From the left of the screen, with rightward velocity
+	else if(where < weighted_chance + (1 - weighted_chance) / 2) {
+		y = getRand(rng) * (st->height - a_h);
+		x = 0 - a_w;
+		dy /= 2;
+	}
+
+	// From the right of the screen, with leftward velofity
+	else {
+		y = getRand(rng) * (st->height - a_h);
+		x = st->width;
+		dy /= 2;
+		dx *= -1;
+	}
+
+	// Load the sprite with the computed parameters
+	Sprite a = loadSprite(ASTER, x, y);
+	a.dx = dx;
+	a.dy = dy;
+	a.omega = ((getRand(rng) * 0.1) - 0.05) * st->score / 16000.0;
+	return a;
+}
+
+void breakAsteroid(State* st, const Sprite* a)
+{
+	Rng* rng = &st->rng;
+	for(int i = 0; i < 4; i++) {
+		int x = a->x + 2 + (1.3 * a->w / 2 - 2) * (i >= 2);
+		int y = a->y + 2 + (1.3 * a->h / 2 - 2) * (i > 0 && i < 3);
+		Sprite f = loadSprite(FRAGMENT, x, y);
+		f.dx = a->dx * (1 + getRand(rng) * 0.2 - 0.1);
+		f.dy = a->dy * (1 + getRand(rng) * 0.2 - 0.1);
+		if(i >= 2) {
+			f.dx += 0.1;
+		}
+		else {
+			f.dx -= 0.1;
+		}
+		if(i > 0 && i < 3) {
+			f.dy += 0.1;
+		}
+		else {
+			f.dy -= 0.1;
+		}
+		f.theta = (i + getRand(rng) * 0.4 - 0.2) * M_PI_2;
+		f.omega = a->omega * (0.5 + getRand(rng) * 0.2 - 0.1);
+		addSprite(&st->sprites, f);
+		PROFILE_COUNT(st->prof, COUNT_SPAWNS, 1);
+	}
+}
+
+// If the sprite pool is empty, inserts an asteroid, to make sure there is
+// never an empty pool.
+static void ensureAsteroids(State* st)
+{
+	if(st->sprites.n == 0) {
+		addSprite(&st->sprites, spawnAsteroid(st));
+		PROFILE_COUNT(st->prof, COUNT_SPAWNS, 1);
+	}
+#ifdef CBMC
+	__CPROVER_assert(st->sprites.n > 0, "There should always be asteroids");
+#endif // CBMC
+
+}
+
+// Set up the state of a fresh game: ship in the middle, one asteroid. Every
+// random number of the game is drawn from a stream started from seed.
+void newGame(State* st, uint64_t seed)
+{
+	// Ship size
+	int ship_w = shapes[SHIP].w;
+	int ship_h = shapes[SHIP].h;
+
+	// Initial state
+	st->width = SCREEN_WIDTH;
+	st->height = SCREEN_HEIGHT;
+	double c_x = (double) (st->width - ship_w) / 2;
+	double c_y = (double) (st->height - ship_h) / 2;
+	st->ship = loadSprite(SHIP, c_x, c_y);
+	updateSpriteHitbox(&st->ship);
+	st->score = 0;
+	st->seed = seed;
+	seedRng(&st->rng, seed);
+	st->laser_cooldown = 0;
+	st->thrust = false;
+	st->step = 1;
+	st->invincible = false;
+	st->no_spawns = false;
+	st->sfx = (SfxQueue) { 0 };
+	st->prof = NULL;
+	st->workers = NULL;
+
+	// "seed" the pool with one asteroid - we don't want it to be empty.
+	st->sprites = (SpritePool) { 0 };
+	st->grid = (Grid) { 0 };
+	ensureAsteroids(st);
+}
+
+// Destroy every sprite in a pool and free the pool
+static void unloadSprites(SpritePool* p)
+{
+	free(p->free);
+	free(p->alive);
+	free(p->x);
+	free(p->y);
+	free(p->dx);
+	free(p->dy);
+	free(p->theta);
+	free(p->omega);
+	free(p->px);
+	free(p->py);
+	free(p->ptheta);
+	free(p->id);
+	free(p->w);
+	free(p->h);
+	free(p->shape);
+	free(p->hb);
+	free(p->mark);
+}
+
+// Free the collision grid buffers
+static void unloadGrid(Grid* g)
+{
+	free(g->start);
+	free(g->fill);
+	free(g->cell_of);
+	free(g->items);
+	for(int i = 0; i < g->ncand; i++) free(g->cand[i]);
+	free(g->cand);
+	for(int i = 0; i < g->nhits; i++) free(g->hits[i].pairs);
+	free(g->hits);
+}
+
+// Free the state of a game
+void unloadGame(State* st)
+{
+	unloadSprites(&st->sprites);
+	unloadGrid(&st->grid);
+}
+
+// Most bytes a snapshot of a pool with top slots in use can take
+size_t snapshotSize(int top)
+{
+	return sizeof(SnapshotHeader) + top * SNAPSHOT_SLOT;
+}
+
+// Copy n bytes into or out of a snapshot, moving the cursor past them
+static void putBytes(unsigned char** out, const void* v, size_t n)
+{
+	memcpy(*out, v, n);
+	*out += n;
+}
+
+static void getBytes(const unsigned char** in, void* v, size_t n)
+{
+	memcpy(v, *in, n);
+	*in += n;
+}
+
+// Write a snapshot of a game into buf, which must hold
+// snapshotSize(st->sprites.top) bytes. Returns the bytes written.
+size_t saveSnapshot(const State* st, unsigned char* buf)
+{
+	const SpritePool* p = &st->sprites;
+	const Sprite* s = &st->ship;
+	// Zero the padding too, so equal games give byte for byte equal snapshots
+	SnapshotHeader h;
+	memset(&h, 0, sizeof(h));
+	h.magic = SNAPSHOT_MAGIC;
+	h.size = snapshotSize(p->top);
+	h.score = st->score;
+	h.seed = st->seed;
+	h.rng = st->rng;
+	double ship[9] = { s->x, s->y, s->theta, s->dx, s->dy, s->omega,
+		s->px, s->py, s->ptheta };
+	memcpy(h.ship, ship, sizeof(ship));
+	h.laser_cooldown = st->laser_cooldown;
+	h.thrust = st->thrust;
+	h.top = p->top;
+	h.n = p->n;
+	h.nfree = p->nfree;
+
+	// Whole columns at a time, so saving is a handful of copies
+	unsigned char* out = buf;
+	int top = p->top;
+	putBytes(&out, &h, sizeof(h));
+	putBytes(&out, p->alive, top * sizeof(bool));
+	putBytes(&out, p->id, top * sizeof(int));
+	double* cols[9] = { p->x, p->y, p->theta, p->dx, p->dy, p->omega,
+		p->px, p->py, p->ptheta };
+	for(int c = 0; c < 9; c++) putBytes(&out, cols[c], top * sizeof(double));
+	putBytes(&out, p->free, p->nfree * sizeof(int));
+	return out - buf;
+}
+
+// Make st the game saved in a snapshot. The pool keeps its slot layout and
+// free list, so the restored game plays on exactly as the saved one would
+// have. Sound, profile and scratch buffers are st's own and are kept.
+// Returns false if buf isn't a snapshot.
+bool restoreSnapshot(State* st, const unsigned char* buf)
+{
+	SnapshotHeader h;
+	const unsigned char* in = buf;
+	getBytes(&in, &h, sizeof(h));
+	if(h.magic != SNAPSHOT_MAGIC || h.size != snapshotSize(h.top)) return false;
+
+	st->score = h.score;
+	st->seed = h.seed;
+	st->rng = h.rng;
+	st->laser_cooldown = h.laser_cooldown;
+	st->thrust = h.thrust;
+
+	Sprite* s = &st->ship;
+	*s = loadSprite(SHIP, h.ship[0], h.ship[1]);
+	s->theta = h.ship[2];
+	s->dx = h.ship[3];
+	s->dy = h.ship[4];
+	s->omega = h.ship[5];
+	s->px = h.ship[6];
+	s->py = h.ship[7];
+	s->ptheta = h.ship[8];
+	updateSpriteHitbox(s);
+
+	SpritePool* p = &st->sprites;
+	while(p->cap < h.top) growPool(p);
+	p->top = h.top;
+	p->n = h.n;
+	p->nfree = h.nfree;
+	getBytes(&in, p->alive, h.top * sizeof(bool));
+	getBytes(&in, p->id, h.top * sizeof(int));
+	double* cols[9] = { p->x, p->y, p->theta, p->dx, p->dy, p->omega,
+		p->px, p->py, p->ptheta };
+	for(int c = 0; c < 9; c++) getBytes(&in, cols[c], h.top * sizeof(double));
+	getBytes(&in, p->free, h.nfree * sizeof(int));
+
+	// Everything else about a slot follows from its type and position
+	memset(p->count, 0, sizeof(p->count));
+	for(int i = 0; i < h.top; i++) {
+		if(p->alive[i]) p->count[p->id[i]]++;
+		p->shape[i] = &shapes[p->id[i]];
+		p->w[i] = p->shape[i]->w;
+		p->h[i] = p->shape[i]->h;
+		updatePoolHitbox(p, i);
+	}
+	return true;
+}
+
+static Circle makeCircle(const Hitbox* hb, double radius)
+{
+	Circle circle;
+	circle.x = hb->cx;
+	circle.y = hb->cy;
+	circle.r = radius;
+	return circle;
+}
+
+// Compares squared distances, so no square root. Circles with a negative
+// radius never intersect.
+static bool circleIntersect(Circle c1, Circle c2)
+{
+	double dx = c1.x - c2.x;
+	double dy = c1.y - c2.y;
+	double r = c1.r + c2.r;
+	return r >= 0 && dx * dx + dy * dy <= r * r;
+}
+
+// Whether the enclosing boxes of two hitboxes overlap
+static bool boundsOverlap(const Hitbox* h1, const Hitbox* h2)
+{
+	return !(h1->x1 < h2->x0 || h2->x1 < h1->x0 || h1->y1 < h2->y0
+			|| h2->y1 < h1->y0);
+}
+
+// Whether the enclosing circles of two hitboxes overlap. Rotated sprites are
+// often apart even when their enclosing boxes touch.
+static bool circlesOverlap(const Hitbox* h1, const Hitbox* h2)
+{
+	return circleIntersect(makeCircle(h1, h1->r), makeCircle(h2, h2->r));
+}
+
+// How far a pair of hitboxes gets through the checks of colliding(): apart
+// by their enclosing boxes, by their enclosing circles, by the separating axis
+// test, or touching
+enum collide_stages
+{ APART_BOUNDS, APART_CIRCLES, APART_SAT, TOUCHING };
+
+// Precisely check if sprites are touching by comparing their arrays of
+// bounding boxes. Returns the stage the checks stopped at, so profiling can
+// count them without repeating any.
+static int colliding(const Hitbox* h1, const Hitbox* h2)
+{
+	// Sprites whose enclosing boxes or circles are apart can't have touching
+	// hitboxes
+	if(!boundsOverlap(h1, h2)) return APART_BOUNDS;
+	if(!circlesOverlap(h1, h2)) return APART_CIRCLES;
+
+	// Separating axis test on every pair of boxes
+	bool collision = satOverlap(h1, h2);
+
+#ifdef CBMC
+	if(collision) {
+		// Overapproximation
+		Circle circle1 = makeCircle(h1, h1->r);
+		Circle circle2 = makeCircle(h2, h2->r);
+		__CPROVER_assert(circleIntersect(circle1, circle2),
+				"Colliding -- overapproximation should also collide!");
+	}
+	else {
+		// Underapproximation
+		Circle circle1 = makeCircle(h1, h1->inner);
+		Circle circle2 = makeCircle(h2, h2->inner);
+		__CPROVER_assert(!circleIntersect(circle1, circle2),
+				"Not colliding -- underapproximation should not collide!");
+	}
+#endif // CBMC
+	return collision ? TOUCHING : APART_SAT;
+}
+
+// Interval covered by the corners of a box projected onto (nx, ny)
+static void projectBox(const double* bb, double nx, double ny, double* lo,
+		double* hi)
+{
+	*lo = INFINITY;
+	*hi = -INFINITY;
+	for(int k = 0; k < 4; k++) {
+		double d = bb[2 * k + 0] * nx + bb[2 * k + 1] * ny;
+		*lo = min(*lo, d);
+		*hi = max(*hi, d);
+	}
+}
+
+// Check if h1 touched h2 at any point of a step over which it moved (dx, dy)
+// relative to h2, ending where it is now. Boxes keep their final rotation
+// for the sweep. A box swept in a straight line covers the convex hull of
+// where it started and ended, so a pair of boxes is apart exactly when an
+// edge normal of either box, or the normal of the motion, separates that
+// hull from the other box. For a laser, this is its whole 2x12 box swept
+// against every box of a rock.
+static bool sweptColliding(const Hitbox* h1, double dx, double dy,
+		const Hitbox* h2)
+{
+	// Enclosing boxes, the first stretched back over the whole step
+	if(h1->x1 - min(dx, 0) < h2->x0 || h2->x1 < h1->x0 - max(dx, 0)
+			|| h1->y1 - min(dy, 0) < h2->y0 || h2->y1 < h1->y0 - max(dy, 0)) {
+		return false;
+	}
+
+	for(int i = 0; i < h1->n; i++) {
+		for(int j = 0; j < h2->n; j++) {
+			const double* a = h1->corners[i];
+			const double* b = h2->corners[j];
+			double axes[5][2] = {
+				{ a[1] - a[3], a[2] - a[0] }, { a[1] - a[5], a[4] - a[0] },
+				{ b[1] - b[3], b[2] - b[0] }, { b[1] - b[5], b[4] - b[0] },
+				{ -dy, dx }
+			};
+			bool apart = false;
+			for(int k = 0; k < 5 && !apart; k++) {
+				double alo, ahi, blo, bhi;
+				projectBox(a, axes[k][0], axes[k][1], &alo, &ahi);
+				projectBox(b, axes[k][0], axes[k][1], &blo, &bhi);
+				double s = dx * axes[k][0] + dy * axes[k][1];
+				alo -= max(s, 0);
+				ahi -= min(s, 0);
+				apart = ahi < blo || bhi < alo;
+			}
+			if(!apart) return true;
+		}
+	}
+	return false;
+}
+
+static bool isLaser(int id)
+{
+	return id == LASER;
+}
+
+static bool isRock(int id)
+{
+	return (id == ASTER || id == FRAGMENT);
+}
+
+// Grid cell containing a point. Points outside the grid are clamped to the
+// border cells, which can only bring them closer to their neighbours.
+static inline int gridCell(const Grid* g, double x, double y, int* col, int* row)
+{
+	int c = (x + g->margin) / g->cell;
+	int r = (y + g->margin) / g->cell;
+	*col = c < 0 ? 0 : (c >= g->cols ? g->cols - 1 : c);
+	*row = r < 0 ? 0 : (r >= g->rows ? g->rows - 1 : r);
+	return *row * g->cols + *col;
+}
+
+// List of cells a sprite goes in: lasers in their own, everything else with
+// the rocks
+static inline int gridKind(const Grid* g, const SpritePool* p, int i)
+{
+	return isLaser(p->id[i]) * g->cols * g->rows;
+}
+
+// Bucket every live sprite of the pool into the grid by the center of its
+// hitbox, so each cell holds its sprites by ascending slot. reach is the most
+// two sprites can have moved towards each other over the step, for swept
+// collisions. The grid covers a world of width by height and a margin around
+// it.
+static void buildGrid(Grid* g, const SpritePool* p, int width, int height,
+		int threads, double reach)
+{
+	// Size cells from the largest hitbox template, plus a couple of pixels of
+	// slack for the integer truncation in hitboxes and room for the sweep
+	double extent = 0;
+	for(int id = 0; id < NUM_SPRITES; id++) {
+		extent = max(extent, 2 * shapes[id].radius + 4 + reach);
+	}
+	if(extent != g->cell) {
+		g->cell = extent;
+		g->margin = 100 + extent;
+	}
+	int cols = (width  + 2 * g->margin) / g->cell + 1;
+	int rows = (height + 2 * g->margin) / g->cell + 1;
+	if(cols != g->cols || rows != g->rows) {
+		g->cols = cols;
+		g->rows = rows;
+		g->start = realloc(g->start, sizeof(int) * (2 * g->cols * g->rows + 1));
+		g->fill  = realloc(g->fill,  sizeof(int) * (2 * g->cols * g->rows));
+	}
+	if(p->top > g->cap || threads > g->ncand) {
+		g->cap = max(g->cap, p->cap);
+		g->cell_of = realloc(g->cell_of, sizeof(int) * g->cap);
+		g->items   = realloc(g->items,   sizeof(int) * g->cap);
+		g->cand    = realloc(g->cand, sizeof(int*) * max(g->ncand, threads));
+		for(int i = 0; i < max(g->ncand, threads); i++) {
+			if(i >= g->ncand) g->cand[i] = NULL;
+			g->cand[i] = realloc(g->cand[i], sizeof(int) * g->cap);
+		}
+		g->ncand = max(g->ncand, threads);
+	}
+
+	// Count sprites per cell of each list, then bucket them with a stable
+	// counting sort
+	int ncells = 2 * g->cols * g->rows;
+	memset(g->start, 0, sizeof(int) * (ncells + 1));
+	for(int i = 0; i < p->top; i++) {
+		if(!p->alive[i]) continue;
+		int col, row;
+		g->cell_of[i] = gridCell(g, p->hb[i].cx, p->hb[i].cy, &col, &row);
+		g->start[gridKind(g, p, i) + g->cell_of[i] + 1]++;
+	}
+	for(int c = 0; c < ncells; c++) {
+		g->start[c + 1] += g->start[c];
+		g->fill[c] = g->start[c];
+	}
+	for(int i = 0; i < p->top; i++) {
+		if(!p->alive[i]) continue;
+		g->items[g->fill[gridKind(g, p, i) + g->cell_of[i]]++] = i;
+	}
+}
+
+// Collect the slots j > i of rocks, and of lasers too if asked, in the same or
+// neighbouring cells as sprite i into cand, sorted ascending. Returns how many
+// were found.
+static int gridNeighbours(const Grid* g, int i, bool lasers, int* cand)
+{
+	// Each cell is already sorted, so find where j > i starts in each of them
+	int lo[18];
+	int hi[18];
+	int runs = 0;
+	int col = g->cell_of[i] % g->cols;
+	int row = g->cell_of[i] / g->cols;
+	int kinds = lasers ? 2 : 1;
+	for(int k = 0; k < kinds; k++) {
+		for(int r = max(row - 1, 0); r <= min(row + 1, g->rows - 1); r++) {
+			for(int c = max(col - 1, 0); c <= min(col + 1, g->cols - 1); c++) {
+				int cell = (k * g->rows + r) * g->cols + c;
+				int a = g->start[cell];
+				int b = g->start[cell + 1];
+				while(a < b) {
+					int m = (a + b) / 2;
+					if(g->items[m] > i) b = m;
+					else a = m + 1;
+				}
+				if(a < g->start[cell + 1]) {
+					lo[runs] = a;
+					hi[runs] = g->start[cell + 1];
+					runs++;
+				}
+			}
+		}
+	}
+
+	// Merge the sorted runs, which keeps the original pair order
+	int n = 0;
+	while(runs > 0) {
+		int best = 0;
+		for(int r = 1; r < runs; r++) {
+			if(g->items[lo[r]] < g->items[lo[best]]) best = r;
+		}
+		cand[n++] = g->items[lo[best]++];
+		if(lo[best] == hi[best]) {
+			runs--;
+			lo[best] = lo[runs];
+			hi[best] = hi[runs];
+		}
+	}
+	return n;
+}
+
+// How far the ship moved over the last step. Wrapping around the world
+// counts as not moving, since the ship didn't cross the space in between.
+static void shipTravel(const State* st, double* dx, double* dy)
+{
+	const Sprite* s = &st->ship;
+	*dx = s->x - s->px;
+	*dy = s->y - s->py;
+	if(fabs(*dx) > st->width / 2) *dx = 0;
+	if(fabs(*dy) > st->height / 2) *dy = 0;
+}
+
+// Add a colliding pair to a hit list
+static void addHit(HitList* h, int i, int j)
+{
+	if(h->n == h->cap) {
+		h->cap = h->cap ? h->cap * 2 : 16;
+		h->pairs = realloc(h->pairs, sizeof(int) * 2 * h->cap);
+	}
+	h->pairs[2 * h->n + 0] = i;
+	h->pairs[2 * h->n + 1] = j;
+	h->n++;
+}
+
+// Narrow phase for one chunk of slots: test every candidate pair and the ship,
+// and list what collides. Only reads the state, so chunks can run on any
+// thread in any order; worker picks the candidate buffer to use.
+static void findHits(void* arg, int chunk, int worker)
+{
+	const State* st = arg;
+	const SpritePool* p = &st->sprites;
+	const Grid* g = &st->grid;
+	HitList* h = &g->hits[chunk];
+	int* cand = g->cand[worker];
+	h->n = 0;
+	h->ship = -1;
+	memset(h->counts, 0, sizeof(h->counts));
+
+	// Cell of the ship, to skip rocks that are nowhere near it
+	int ship_col, ship_row;
+	gridCell(g, st->ship.hb.cx, st->ship.hb.cy, &ship_col, &ship_row);
+
+	// How far the ship moved over the step
+	const Sprite* s = &st->ship;
+	bool swept = st->step > 1;
+	double ship_dx, ship_dy;
+	shipTravel(st, &ship_dx, &ship_dy);
+
+	int end = min((chunk + 1) * COLLIDE_CHUNK, p->top);
+	for(int i = chunk * COLLIDE_CHUNK; i < end && h->ship < 0; i++) {
+		if(!p->alive[i]) continue;
+
+		// Only pairs in neighbouring cells that can collide are tested, rocks
+		// against rocks and lasers and lasers against rocks, in the same
+		// (i, j) order as a full scan
+		bool rock = isRock(p->id[i]);
+		int n = gridNeighbours(g, i, rock, cand);
+		for(int k = 0; k < n; k++) {
+			int j = cand[k];
+			double dx = (p->x[i] - p->px[i]) - (p->x[j] - p->px[j]);
+			double dy = (p->y[i] - p->py[i]) - (p->y[j] - p->py[j]);
+			int stage = colliding(&p->hb[i], &p->hb[j]);
+			if(stage == TOUCHING
+					|| (swept && sweptColliding(&p->hb[i], dx, dy, &p->hb[j]))) {
+				addHit(h, i, j);
+			}
+
+#ifdef PROFILE
+			h->counts[COUNT_PAIRS]++;
+			h->counts[COUNT_SAT] += stage >= APART_SAT;
+			h->counts[COUNT_CIRCLE_REJECTS] += stage == APART_CIRCLES;
+#endif // PROFILE
+		}
+
+		// Rock-ship collisions end the game
+		int col = g->cell_of[i] % g->cols;
+		int row = g->cell_of[i] / g->cols;
+		bool near = rock && abs(col - ship_col) <= 1
+			&& abs(row - ship_row) <= 1;
+		double dx = ship_dx - (p->x[i] - p->px[i]);
+		double dy = ship_dy - (p->y[i] - p->py[i]);
+		int stage = near ? colliding(&s->hb, &p->hb[i]) : APART_BOUNDS;
+		if(near && (stage == TOUCHING
+				|| (swept && sweptColliding(&s->hb, dx, dy, &p->hb[i])))
+				&& !st->invincible) {
+			h->ship = i;
+		}
+
+#ifdef PROFILE
+		h->counts[COUNT_PAIRS] += near;
+		h->counts[COUNT_SAT] += stage >= APART_SAT;
+		h->counts[COUNT_CIRCLE_REJECTS] += stage == APART_CIRCLES;
+#endif // PROFILE
+	}
+}
+
+// Most any two sprites, or a sprite and the ship, closed in on each other
+// along either axis over the last step. Rounded up, so the grid is only
+// resized now and then.
+static double sweepReach(const State* st)
+{
+	const SpritePool* p = &st->sprites;
+	double dx, dy;
+	shipTravel(st, &dx, &dy);
+	double most = max(fabs(dx), fabs(dy));
+	for(int i = 0; i < p->top; i++) {
+		if(!p->alive[i]) continue;
+		most = max(most, fabs(p->x[i] - p->px[i]));
+		most = max(most, fabs(p->y[i] - p->py[i]));
+	}
+	return ceil(2 * most / 16) * 16;
+}
+
+static bool detectAllCollisions(State* st)
+{
+	SpritePool* p = &st->sprites;
+
+	// Bucket sprites into the broad phase grid, with a candidate buffer for
+	// every thread
+	Grid* g = &st->grid;
+	int threads = st->workers ? st->workers->n : 1;
+	buildGrid(g, p, st->width, st->height, threads,
+			st->step > 1 ? sweepReach(st) : 0);
+
+	// Find colliding pairs chunk by chunk, across the worker threads when
+	// there are enough sprites to be worth it
+	int chunks = (p->top + COLLIDE_CHUNK - 1) / COLLIDE_CHUNK;
+	if(chunks > g->nhits) {
+		g->hits = realloc(g->hits, sizeof(HitList) * chunks);
+		memset(&g->hits[g->nhits], 0, sizeof(HitList) * (chunks - g->nhits));
+		g->nhits = chunks;
+	}
+	if(st->workers && p->top >= PARALLEL_MIN) {
+		runTasks(st->workers, chunks, findHits, st);
+	}
+	else for(int c = 0; c < chunks; c++) findHits(st, c, 0);
+
+	// Hash map of sprites marked for deletion
+	int len = p->top;
+	bool delete[len];
+	for (int i=0; i < len; i++) delete[i] = false;
+
+	// Resolve the hits in slot order, exactly as a serial scan would: a sprite
+	// is destroyed by the first pair it is in, and the game ends at the first
+	// rock to hit the ship, after that rock's own pairs
+#ifdef PROFILE
+	long counts[NUM_COUNTERS] = { 0 };
+	for(int c = 0; c < chunks; c++) {
+		for(int k = 0; k < NUM_COUNTERS; k++) counts[k] += g->hits[c].counts[k];
+	}
+	for(int k = 0; k < NUM_COUNTERS; k++) PROFILE_COUNT(st->prof, k, counts[k]);
+#endif // PROFILE
+	for(int c = 0; c < chunks; c++) {
+		const HitList* h = &g->hits[c];
+		for(int k = 0; k < h->n; k++) {
+			int i = h->pairs[2 * k + 0];
+			int j = h->pairs[2 * k + 1];
+			if(h->ship >= 0 && i > h->ship) return true;
+			if(!delete[i] && !delete[j]) {
+				delete[i] = true;
+				delete[j] = true;
+				queueSfx(st, SFX_CRASH);
+				if(isLaser(p->id[i]) || isLaser(p->id[j])) {
+					st->score += 50;
+				}
+			}
+		}
+		if(h->ship >= 0) return true;
+	}
+
+	// Delete marked sprites and exit. Fragments take free slots: ones freed
+	// earlier in this loop, which it has already passed, ones that were free
+	// before it, which aren't marked, or new ones past len. In every case no
+	// fragment is deleted by the loop that spawned it.
+	for(int i = 0; i < len; i++) {
+#ifdef CBMC
+		__CPROVER_assert(i < p->cap, "Array access out of bounds!");
+#endif // CBMC
+		if(delete[i]) {
+			if(p->id[i] == ASTER) {
+				Sprite a = getSprite(p, i);
+				breakAsteroid(st, &a);
+			}
+			removeSprite(p, i);
+		}
+	}
+	return false;
+}
+
+// Move the ship through space according to our "laws" of physics each frame
+static void moveShip(State* st, int input)
+{
+	Sprite* s = &st->ship;
+
+	// Ship parameters
+	double thrust = 0.08;
+	double thrust_damp = 0.99;
+	double torque = 0.004;
+	double torque_damp = 0.95;
+
+	// The ship is steered frame by frame, however many frames a step covers
+	st->thrust = input & INPUT_UP;
+	for(int f = 0; f < st->step; f++) {
+		// Damping force based on velocity (simulates friction / resistance)
+		s->dx *= thrust_damp;
+		s->dy *= thrust_damp;
+		s->omega *= torque_damp;
+
+		// Apply forces based on input
+		if (input & INPUT_UP) {
+			s->dx += thrust * cos(s->theta);
+			s->dy -= thrust * sin(s->theta);
+		}
+		if (input & INPUT_LEFT) {
+			s->omega += torque;
+		}
+		if (input & INPUT_RIGHT) {
+			s->omega -= torque;
+		}
+
+		// Propagate to derived quantities
+		s->x += s->dx;
+		s->y += s->dy;
+		s->theta += s->omega;
+
+		// Screen wrap
+		if(s->x > st->width)  s->x = 0 - s->w;
+		if(s->y > st->height) s->y = 0 - s->h;
+		if(s->x < 0 - s->w)   s->x = st->width;
+		if(s->y < 0 - s->h)   s->y = st->height;
+	}
+	updateSpriteHitbox(s);
+
+#ifdef CBMC
+	bool xInBound = -s->w <= s->x && s->x <= st->width + s->w;
+	bool yInBound = -s->h <= s->y && s->y <= st->height + s->h;
+	__CPROVER_assert(xInBound && yInBound, "Out of Bounds!");
+#endif // CBMC
+}
+
+// Advance n slots by their velocities over dt frames, in a straight pass the
+// compiler can vectorize
+static void integrate(int n, double dt, double* restrict x,
+		double* restrict y, double* restrict theta, const double* restrict dx,
+		const double* restrict dy, const double* restrict omega)
+{
+	for(int i = 0; i < n; i++) {
+		x[i] += dx[i] * dt;
+		y[i] += dy[i] * dt;
+		theta[i] += omega[i] * dt;
+	}
+}
+
+// Move the asteroids through space according to "laws" of physics each frame
+// No forces are applied to asteroids, they just travel through space.
+// They don't wrap around the screen either.
+static void moveSprites(State* st)
+{
+	// Dead slots have no velocity, so every slot can be moved at once
+	SpritePool* p = &st->sprites;
+	integrate(p->top, st->step, p->x, p->y, p->theta, p->dx, p->dy, p->omega);
+	for(int i = 0; i < p->top; i++) if(p->alive[i]) updatePoolHitbox(p, i);
+}
+
+// There is a chance of spawning a new asteroid each frame, randomly placed,
+// if there are less than the maximum number of asteroids out already
+static void checkSpawnAsteroid(State* st)
+{
+#ifdef CBMC
+	__CPROVER_precondition(st->sprites.n > 0, "There are always asteroids.");
+#endif //CBMC
+	if(st->no_spawns) return;
+
+	// Controls how many asteroids are on screen
+	double spawn_chance = 0.05;
+	int n_ast = st->score / 1000 + 3;
+
+	// Count asteroids, a fragment being a quarter of one
+	const SpritePool* p = &st->sprites;
+	double n = p->count[ASTER] + 0.25 * p->count[FRAGMENT];
+
+	// If we're under capacity, chance to add a new asteroid to the pool, once
+	// for every frame of the step
+	for(int f = 0; f < st->step; f++) {
+		if(n < n_ast && getRand(&st->rng) < spawn_chance) {
+			addSprite(&st->sprites, spawnAsteroid(st));
+			PROFILE_COUNT(st->prof, COUNT_SPAWNS, 1);
+			n += 1.0;
+		}
+	}
+
+#ifdef CBMC
+	// There should still be asteroids after the fact
+	__CPROVER_postcondition(st->sprites.n > 0, "Must be > 0 asteroids");
+#endif //CBMC
+}
+
+// Flag which of n slots are more than radius pixels outside a world of width
+// by height, in a straight pass the compiler can vectorize
+static void offScreen(int n, int width, int height, int radius,
+		bool* restrict off, const double* restrict x, const double* restrict y,
+		const int* restrict w, const int* restrict h)
+{
+	for(int i = 0; i < n; i++) {
+		off[i] = (x[i] > width  + radius) | (x[i] + w[i] < 0 - radius)
+		       | (y[i] > height + radius) | (y[i] + h[i] < 0 - radius);
+	}
+}
+
+// Handles garbage collection of asteroids after they've left the screen
+static void checkDespawnSprites(State* st)
+{
+	// How far off screen a sprite should be before it is despawned
+	int radius = 100;
+
+	// Flag every slot that is off screen in one pass
+	SpritePool* p = &st->sprites;
+	bool* off = p->mark;
+	offScreen(p->top, st->width, st->height, radius, off, p->x, p->y, p->w,
+			p->h);
+
+	// Remove the live sprites that were flagged
+	for(int i = 0; i < p->top; i++) {
+		if(!off[i] || !p->alive[i]) continue;
+		removeSprite(p, i);
+		PROFILE_COUNT(st->prof, COUNT_DESPAWNS, 1);
+	}
+
+	// If there are no sprites left, force an asteroid to spawn
+	// (the pool should never be empty)
+	ensureAsteroids(st);
+}
+
+void fireLaser(State* st)
+{
+	// Laser data. Velocity is at least 4, but in general is a little higher
+	// than the ship's velocity, so the ship can never outrun its own lasers
+	const Sprite* ship = &st->ship;
+	int l_h = shapes[LASER].h;
+	int l_v = max(6, 2 + sqrt(ship->dx * ship->dx + ship->dy * ship->dy));
+
+	// Stupid bullshit to line up the position of the (rotated) laser with the
+	// (rotated) nose of the ship. Don't ask how I derived this.
+	int w = ship->w;
+	int h = ship->h;
+	double t = ship->theta;
+	int l_x = ship->x + (w * (1 + cos(t)) + l_h * sin(t + M_PI_2)) / 2;
+	int l_y = ship->y + (h - w * sin(t) - l_h * (1 - cos(t + M_PI_2))) / 2;
+
+	// Spawn laser and set its direction and velocity
+	Sprite lz = loadSprite(LASER, l_x, l_y);
+	lz.theta = t + M_PI_2;
+	lz.dx = l_v *  cos(t);
+	lz.dy = l_v * -sin(t);
+
+	// Add laser to the pool of active sprites
+	addSprite(&st->sprites, lz);
+	PROFILE_COUNT(st->prof, COUNT_SPAWNS, 1);
+
+	// Laser sound effect
+	queueSfx(st, SFX_LASER);
+
+	/* Ship is never faster than the laser. */
+	/* What a terrible engineering feat it would be if this were true! */
+#ifdef CBMC
+	__CPROVER_assert(abs(st->ship.dx) <= abs(lz.dx),
+			"Ship dx faster than laser!");
+	__CPROVER_assert(abs(st->ship.dy) <= abs(lz.dy),
+			"Ship dy faster than laser!");
+#endif // CBMC
+}
+
+static void updateLasers(State* st, int input)
+{
+	// A cooldown below zero, once the score is high enough, never runs out
+	if(st->laser_cooldown > 0) {
+		st->laser_cooldown = max(st->laser_cooldown - st->step, 0);
+	}
+	if(st->laser_cooldown == 0 && (input & INPUT_FIRE)) {
+		st->laser_cooldown = 50 - st->score / 400;
+		fireLaser(st);
+	}
+}
+
+// Remember where everything is before a step, so frames drawn between steps
+// can be interpolated
+static void savePositions(State* st)
+{
+	Sprite* s = &st->ship;
+	s->px = s->x;
+	s->py = s->y;
+	s->ptheta = s->theta;
+
+	SpritePool* p = &st->sprites;
+	memcpy(p->px, p->x, sizeof(double) * p->top);
+	memcpy(p->py, p->y, sizeof(double) * p->top);
+	memcpy(p->ptheta, p->theta, sizeof(double) * p->top);
+}
+
+// Use player input to update the game state
+bool updateGame(State* st, int input)
+{
+	savePositions(st);
+
+	// Ship moves
+	PROFILE_BEGIN(st->prof, PHASE_SHIP);
+	moveShip(st, input);
+	PROFILE_END(st->prof, PHASE_SHIP);
+
+	// Asteroids and lasers move
+	PROFILE_BEGIN(st->prof, PHASE_MOVE);
+	moveSprites(st);
+	PROFILE_END(st->prof, PHASE_MOVE);
+
+	// Collision detection and resolution
+	// Returns true if the ship hit an asteroid
+	PROFILE_BEGIN(st->prof, PHASE_COLLIDE);
+	bool dead = detectAllCollisions(st);
+	PROFILE_END(st->prof, PHASE_COLLIDE);
+	if(dead) return true;
+
+	// Laser cooldown, check if player wants to fire a laser
+	PROFILE_BEGIN(st->prof, PHASE_LASERS);
+	updateLasers(st, input);
+	PROFILE_END(st->prof, PHASE_LASERS);
+
+	// When a sprite goes off screen, it is despawned
+	PROFILE_BEGIN(st->prof, PHASE_DESPAWN);
+	checkDespawnSprites(st);
+	PROFILE_END(st->prof, PHASE_DESPAWN);
+
+	// Each frame, a new asteroid might spawn
+	PROFILE_BEGIN(st->prof, PHASE_SPAWN);
+	checkSpawnAsteroid(st);
+	PROFILE_END(st->prof, PHASE_SPAWN);
+
+	// Score goes up by 1 per frame
+	st->score += st->step;
+
+	return false;
+}
@@ -1,908 +1,1454 @@
 #include "../headers/constants.h"
 #include "../headers/forma.h"
+#include "../headers/game.h"
+#include "../headers/workers.h"
+#include "../headers/profile.h"
+#include "../headers/replay.h"
 #include <assert.h>
 
-// Window, renderer, font, music
-SDL_Window* window = NULL;
-SDL_Renderer* renderer = NULL;
-TTF_Font* font = NULL;
-Mix_Music* music = NULL;
-Mix_Chunk** sfx = NULL;
-Mix_Chunk* thrust_sfx = NULL;
-SDL_Texture** textures = NULL;
-int thrust_ch = -1;
-bool debug = false;
-
-// Game state is captured by this data structure
-typedef struct State
-{
-	long long score;
-	Sprite* ship;
-	int laser_cooldown;
-	bool thrust;
-	SpriteList* sprites;
-}
-State;
-
-typedef struct Circle {
-	double x;
-	double y;
-	double r;
-} Circle;
+// Start and end of each part of startup on one thread, in performance counter
+// ticks, for --debug
+#define MAX_STARTUP 24
+typedef struct Startup
+{
+	Uint64 origin;
+	int n;
+	const char* what[MAX_STARTUP];
+	Uint64 start[MAX_STARTUP];
+	Uint64 end[MAX_STARTUP];
+}
+Startup;
+
+// Thread loading the audio and font of an interactive game, and the glyphs
+// it rasterized, waiting to become the atlas texture
+typedef struct Loader
+{
+	pthread_t thread;
+	Media* m;
+	SDL_Surface* glyphs;
+	Startup log;
+}
+Loader;
+
+// Open an asset for SDL to read: its slice of the bundle if there is one
+// that has it, otherwise the loose file
+SDL_RWops* openAsset(const Media* m, const char* path)
+{
+	size_t size;
+	const void* data = findInPack(&m->pack, path, &size);
+	if(data) return SDL_RWFromConstMem(data, size);
+	return SDL_RWFromFile(path, "rb");
+}
 
 // Load an SDL texture from a BMP file
-SDL_Texture* loadTexture(const char* path)
+SDL_Texture* loadTexture(Media* m, const char* path)
 {
 	// Create a surface from path to bitmap file
 	SDL_Texture* newTexture = NULL;
-	SDL_Surface* loaded = SDL_LoadBMP(path);
+	SDL_Surface* loaded = SDL_LoadBMP_RW(openAsset(m, path), 1);
 
 	// Create a texture from the surface
-	newTexture = SDL_CreateTextureFromSurface(renderer, loaded);
+	newTexture = SDL_CreateTextureFromSurface(m->renderer, loaded);
 	SDL_FreeSurface(loaded);
 	return newTexture;
 }
 
-// Play a sound effect
-void playSfx(int sfx_id, int dur)
-{
-	Mix_ExpireChannel(Mix_PlayChannel(-1, sfx[sfx_id], 0), dur);
+// Rasterize every printable character of a font into one surface, so text
+// can be drawn by copying from one texture instead of rendering it each frame.
+// Needs no renderer; the atlas texture is made from the returned surface.
+SDL_Surface* loadGlyphs(GlyphAtlas* a, TTF_Font* f)
+{
+	char glyphs[NUM_GLYPHS + 1];
+	for(int i = 0; i < NUM_GLYPHS; i++) glyphs[i] = FIRST_GLYPH + i;
+	glyphs[NUM_GLYPHS] = '\0';
+
+	// Each glyph starts where the text before it ends
+	a->x[0] = 0;
+	for(int i = 1; i <= NUM_GLYPHS; i++) {
+		char c = glyphs[i];
+		glyphs[i] = '\0';
+		TTF_SizeText(f, glyphs, &a->x[i], &a->h);
+		glyphs[i] = c;
+	}
+
+	SDL_Color white = { 255, 255, 255 };
+	return TTF_RenderText_Solid(f, glyphs, white);
 }
-
-// Load new sprite into the game
-Sprite* loadSprite(int id, int w, int h, double x, double y,
-		int nbb, SDL_Rect* bb)
-{
-	Sprite* s = malloc(sizeof(Sprite));
-	s->id = id;
-	s->t = textures[id];
-	s->w = w;
-	s->h = h;
-	s->x = x;
-	s->y = y;
-	s->theta = M_PI_2;
-	s->dx = 0;
-	s->dy = 0;
-	s->omega = 0;
-	s->nbb = nbb;
-	s->bb = bb;
-	return s;
-}
-
-// Add a new sprite to the head of the linked list of sprites
-void addSprite(State* st, Sprite* s)
-{
-	SpriteList* head = malloc(sizeof(SpriteList));
-	head->prev = NULL;
-	head->next = st->sprites;
-	head->sprite = s;
-	if(st->sprites) st->sprites->prev = head;
-	st->sprites = head;
-}
-
-// Create a new asteroid at a random position off the edge of the screen,
-// with a random inward velocity
-Sprite* spawnAsteroid(State* st)
-{
-	// Width and height of the asteroid
-	int a_w = 84;
-	int a_h = 83;
-
-	// Weight the chances towards spawning an asteroid on the longer edge, to
-	// even out the distribution of where they appear across the perimeter
-	double ratio = (double) SCREEN_WIDTH / (double) SCREEN_HEIGHT;
-	double weighted_chance = ratio * 0.5;
-
-	// Values to fill
-	double x = 0.0;
-	double y = 0.0;
-	double dx = min(((getRand() * 2.5) + 0.5) * (0.5 + st->score / 16000.0), 3);
-	double dy = min(((getRand() * 2.5) + 0.5) * (0.5 + st->score / 16000.0), 3);
-
-	// From the top of the screen, with downward velocity
-	double where = getRand();
-	if(where < weighted_chance / 2) {
-		x = getRand() * (SCREEN_WIDTH - a_w);
-		y = 0 - a_h;
-		dx /= 2;
-	}
-
-	// From the bottom of the screen, with upward velocity
-	else if(where < weighted_chance) {
-		x = getRand() * (SCREEN_WIDTH - a_w);
-		y = SCREEN_HEIGHT;
-		dx /= 2;
-		dy *= -1;
-	}
-
-	// From the left of the screen, with rightward velocity
-	else if(where < weighted_chance + (1 - weighted_chance) / 2) {
-		y = getRand() * (SCREEN_HEIGHT - a_h);
-		x = 0 - a_w;
-		dy /= 2;
-	}
-
-	// From the right of the screen, with leftward velofity
-	else {
-		y = getRand() * (SCREEN_HEIGHT - a_h);
-		x = SCREEN_WIDTH;
-		dy /= 2;
-		dx *= -1;
-	}
-
-	// Load the sprite with the computed parameters
-	int nbb = 5;
-	SDL_Rect* bb = malloc(sizeof(SDL_Rect) * nbb);
-	bb[0] = (SDL_Rect) { 41, 1, 29, 71 };
-	bb[1] = (SDL_Rect) { 1, 18, 80, 23 };
-	bb[2] = (SDL_Rect) { 16, 10, 34, 71 };
-	bb[3] = (SDL_Rect) { 7, 42, 76, 15 };
-	bb[4] = (SDL_Rect) { 73, 54, 6, 15 };
-	Sprite* a = loadSprite(ASTER, a_w, a_h, x, y, nbb, bb);
-	a->dx = dx;
-	a->dy = dy;
-	a->omega = ((getRand() * 0.1) - 0.05) * st->score / 16000.0;
-	return a;
-}
-
-void breakAsteroid(State* st, Sprite* a)
-{
-	int w = 45;
-	int h = 44;
-	for(int i = 0; i < 4; i++) {
-		int x = a->x + 2 + (1.3 * a->w / 2 - 2) * (i >= 2);
-		int y = a->y + 2 + (1.3 * a->h / 2 - 2) * (i > 0 && i < 3);
-		int nbb = 4;
-		SDL_Rect* bb = malloc(sizeof(SDL_Rect) * nbb);
-		bb[0] = (SDL_Rect) { 5, 13, 33, 19 };
-		bb[1] = (SDL_Rect) { 1, 33, 38, 8 };
-		bb[2] = (SDL_Rect) { 37, 2, 7, 19 };
-		bb[3] = (SDL_Rect) { 19, 9, 19, 5 };
-		Sprite* f = loadSprite(FRAGMENT, w, h, x, y, nbb, bb);
-		f->dx = a->dx * (1 + getRand() * 0.2 - 0.1);
-		f->dy = a->dy * (1 + getRand() * 0.2 - 0.1);
-		if(i >= 2) {
-			f->dx += 0.1;
-		}
-		else {
-			f->dx -= 0.1;
-		}
-		if(i > 0 && i < 3) {
-			f->dy += 0.1;
-		}
-		else {
-			f->dy -= 0.1;
-		}
-		f->theta = (i + getRand() * 0.4 - 0.2) * M_PI_2;
-		f->omega = a->omega * (0.5 + getRand() * 0.2 - 0.1);
-		addSprite(st, f);
+
+// Start an empty batch of triangles drawn with texture t, which may be NULL
+void loadBatch(Batch* b, SDL_Texture* t)
+{
+	*b = (Batch) { 0 };
+	b->t = t;
+	b->tw = 1;
+	b->th = 1;
+	if(t) SDL_QueryTexture(t, NULL, NULL, &b->tw, &b->th);
+}
+
+// Make room for n more vertices in a batch
+static inline SDL_Vertex* batchVertices(Batch* b, int n)
+{
+	if(b->n + n > b->cap) {
+		b->cap = max(b->cap * 2, b->n + n);
+		b->v = realloc(b->v, sizeof(SDL_Vertex) * b->cap);
+	}
+	b->n += n;
+	return &b->v[b->n - n];
+}
+
+// Queue a quad with corners p (clockwise from the top left) showing the src
+// region of the batch's texture, tinted with color c
+void batchQuad(Batch* b, const SDL_FPoint p[4], const SDL_Rect* src,
+		SDL_Color c)
+{
+	float u0 = (float) src->x / b->tw;
+	float v0 = (float) src->y / b->th;
+	float u1 = (float) (src->x + src->w) / b->tw;
+	float v1 = (float) (src->y + src->h) / b->th;
+	SDL_FPoint uv[4] = { { u0, v0 }, { u1, v0 }, { u1, v1 }, { u0, v1 } };
+
+	// Two triangles, 0-1-2 and 0-2-3
+	static const int order[6] = { 0, 1, 2, 0, 2, 3 };
+	SDL_Vertex* v = batchVertices(b, 6);
+	for(int i = 0; i < 6; i++) {
+		v[i] = (SDL_Vertex) { p[order[i]], c, uv[order[i]] };
 	}
 }
 
-// If the linked list is empty, creates it and inserts an asteroid, to make
-// sure there is never an empty linked list.
-void ensureAsteroids(State* st)
+// Queue an axis aligned copy of the src region of the batch's texture to dst.
+// A 180 degree turn is done by flipping the texture coordinates.
+void batchCopy(Batch* b, const SDL_Rect* src, const SDL_Rect* dst, bool turn)
 {
-	if(!st->sprites) addSprite(st, spawnAsteroid(st));
-#ifdef CBMC
-	__CPROVER_assert(st->sprites != NULL, "There should always be asteroids");
-#endif // CBMC
+	float x0 = dst->x;
+	float y0 = dst->y;
+	float x1 = dst->x + dst->w;
+	float y1 = dst->y + dst->h;
+	SDL_FPoint p[4] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+	if(turn) {
+		SDL_FPoint q[4] = { p[2], p[3], p[0], p[1] };
+		memcpy(p, q, sizeof(p));
+	}
+	SDL_Color white = { 255, 255, 255, 255 };
+	batchQuad(b, p, src, white);
+}
 
+// Queue a one pixel wide line from (x1, y1) to (x2, y2), as a thin quad
+void batchLine(Batch* b, double x1, double y1, double x2, double y2,
+		SDL_Color c)
+{
+	double len = sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+	if(len == 0) return;
+	double nx = -(y2 - y1) / len * 0.5;
+	double ny =  (x2 - x1) / len * 0.5;
+	SDL_FPoint p[4] = { { x1 + nx, y1 + ny }, { x2 + nx, y2 + ny }
+	                  , { x2 - nx, y2 - ny }, { x1 - nx, y1 - ny } };
+	SDL_Rect none = { 0, 0, 0, 0 };
+	batchQuad(b, p, &none, c);
 }
 
-// Load SDL and initialize the window, renderer, audio, and data
-bool loadGame(State* st)
+// Draw everything queued in a batch with one call, and empty it
+void flushBatch(SDL_Renderer* renderer, Batch* b)
 {
-	// Ship size
-	int ship_w = 20;
-	int ship_h = 20;
+	if(b->n > 0) SDL_RenderGeometry(renderer, b->t, b->v, b->n, NULL, 0);
+	b->n = 0;
+}
+
+// Channels each sound effect can play on at once, and how long one play
+// lasts in milliseconds. Thrust loops for as long as it's held.
+static const int sfx_voices[NUM_SFX] = {
+	[SFX_LASER] = 3, [SFX_CRASH] = MAX_VOICES, [SFX_THRUST] = 1
+};
+static const int sfx_ms[NUM_SFX] = {
+	[SFX_LASER] = 250, [SFX_CRASH] = 200, [SFX_THRUST] = -1
+};
+
+// Play the sound effects a step asked for and empty the queue. Repeats of an
+// effect within the step play once, since they would start on the same
+// sample anyway, and the thrust loop follows whether the ship is thrusting.
+void flushSfx(Media* m, SfxQueue* q, bool thrust)
+{
+	Voices* v = &m->voices;
+	for(int i = 0; i < NUM_SFX; i++) {
+		if(!q->plays[i]) continue;
+		q->plays[i] = 0;
+		if(sfx_ms[i] < 0) continue;
+
+		// Next channel in turn, cutting short whatever it still plays
+		int ch = v->first[i] + v->next[i];
+		v->next[i] = (v->next[i] + 1) % sfx_voices[i];
+		Mix_ExpireChannel(Mix_PlayChannel(ch, m->sfx[i], 0), sfx_ms[i]);
+	}
+
+	int ch = v->first[SFX_THRUST];
+	if(thrust && !v->looping) Mix_PlayChannel(ch, m->sfx[SFX_THRUST], -1);
+	if(!thrust && v->looping) Mix_HaltChannel(ch);
+	v->looping = thrust;
+}
 
+// Image files of the sprite textures and auxiliary textures
+static const char* texture_paths[NUM_SPRITES] = {
+	[ASTER]    = "graphics/asteroid.bmp",
+	[FRAGMENT] = "graphics/fragment.bmp",
+	[LASER]    = "graphics/laser.bmp",
+	[SHIP]     = "graphics/ship.bmp"
+};
+static const char* aux_texture_paths[NUM_AUX_TEXTURES] = {
+	[TEX_THRUST] = "graphics/thrust.bmp",
+	[TEX_DBG]    = "graphics/dbg.bmp"
+};
+
+// Sound effect files
+static const char* sfx_paths[NUM_SFX] = {
+	[SFX_LASER]  = "audio/laser.wav",
+	[SFX_CRASH]  = "audio/crash.wav",
+	[SFX_THRUST] = "audio/thrust.wav"
+};
+
+// Note that a part of startup ran from start until now, and return now
+Uint64 timeStartup(Startup* log, const char* what, Uint64 start)
+{
+	Uint64 t = SDL_GetPerformanceCounter();
+	if(log->n < MAX_STARTUP) {
+		log->what[log->n] = what;
+		log->start[log->n] = start;
+		log->end[log->n] = t;
+		log->n++;
+	}
+	return t;
+}
+
+// Open the audio device and load the music, sound effects and font, and
+// rasterize the font's glyphs. Runs on its own thread while the window comes
+// up, so it touches nothing that needs the renderer.
+void* runLoader(void* arg)
+{
+	Loader* ld = arg;
+	Media* m = ld->m;
+	Startup* log = &ld->log;
+	Uint64 t = SDL_GetPerformanceCounter();
+
+	// Font library and glyphs
+	TTF_Init();
+	m->font = TTF_OpenFontRW(openAsset(m, "graphics/basis33.ttf"), 1, 24);
+	t = timeStartup(log, "graphics/basis33.ttf", t);
+	ld->glyphs = loadGlyphs(&m->atlas, m->font);
+	t = timeStartup(log, "glyphs", t);
+
+	// Initialize audio
+	Mix_OpenAudio(SAMPLE_RATE, MIX_DEFAULT_FORMAT, NUM_CHANNELS, CHUNK_SIZE);
+	t = timeStartup(log, "audio device", t);
+
+	// Load music and set volume
+	m->music = Mix_LoadMUS_RW(openAsset(m, "audio/music.wav"), 1);
+	Mix_VolumeMusic(100);
+	t = timeStartup(log, "audio/music.wav", t);
+
+	// Sound effects
+	for(int i = 0; i < NUM_SFX; i++) {
+		m->sfx[i] = Mix_LoadWAV_RW(openAsset(m, sfx_paths[i]), 1);
+		t = timeStartup(log, sfx_paths[i], t);
+	}
+
+	// Mixer channels, a run for each sound effect
+	int voices = 0;
+	for(int i = 0; i < NUM_SFX; i++) {
+		m->voices.first[i] = voices;
+		voices += sfx_voices[i];
+	}
+	Mix_AllocateChannels(voices);
+	return NULL;
+}
+
+// Load SDL and initialize the window, renderer, textures and data. Audio and
+// the font load on a separate thread in the meantime, until finishLoading.
+// Everything the first frame draws, bar the HUD text, is ready on return.
+bool loadGame(State* st, Media* m, Loader* ld, Startup* log)
+{
 	// True random seed
 	struct timeval tm;
 	gettimeofday(&tm, NULL);
-	srand(tm.tv_sec + tm.tv_usec * 1000000ul);
+	uint64_t seed = tm.tv_sec * 1000000ull + tm.tv_usec;
 
 	// Initialize SDL
+	Uint64 t = SDL_GetPerformanceCounter();
+	log->origin = t;
 	if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) return false;
+	t = timeStartup(log, "SDL", t);
+
+	// Asset bundle, if there is one. Loose files are read for anything it
+	// doesn't have.
+	openPack(&m->pack, PACK_FILE);
+	t = timeStartup(log, PACK_FILE, t);
+
+	// Audio and font. From here on, a failure waits for the loader before
+	// returning, so it never outlives the media it fills in.
+	*ld = (Loader) { .m = m };
+	ld->log.origin = log->origin;
+	pthread_create(&ld->thread, NULL, runLoader, ld);
 
 	// Create window
-	window = SDL_CreateWindow("FormA", 20, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
-	if(!window) return false;
+	m->window = SDL_CreateWindow("FormA", 20, 0, SCREEN_WIDTH, SCREEN_HEIGHT, 0);
+	if(!m->window) {
+		pthread_join(ld->thread, NULL);
+		return false;
+	}
+	t = timeStartup(log, "window", t);
 
 	// Create renderer for window
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-	if(!renderer) return false;
+	int flags = SDL_RENDERER_ACCELERATED;
+	if(m->vsync) flags |= SDL_RENDERER_PRESENTVSYNC;
+	m->renderer = SDL_CreateRenderer(m->window, -1, flags);
+	if(!m->renderer) {
+		pthread_join(ld->thread, NULL);
+		return false;
+	}
+	t = timeStartup(log, "renderer", t);
 
 	// Initialize renderer color and image loading
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+	SDL_Renderer* r = m->renderer;
+	SDL_SetRenderDrawColor(r, 0, 0, 0, 0xFF);
 
 	// Textures
-	textures = malloc(sizeof(SDL_Texture*) * NUM_SPRITES);
-	textures[ASTER]    = loadTexture("graphics/asteroid.bmp");
-	textures[FRAGMENT] = loadTexture("graphics/fragment.bmp");
-	textures[LASER]    = loadTexture("graphics/laser.bmp");
-	textures[SHIP]     = loadTexture("graphics/ship.bmp");
+	for(int i = 0; i < NUM_SPRITES; i++) {
+		m->textures[i] = loadTexture(m, texture_paths[i]);
+		t = timeStartup(log, texture_paths[i], t);
+	}
 
-	// Font library
-	TTF_Init();
-	font = TTF_OpenFont("graphics/basis33.ttf", 24);
+	// Auxiliary textures, so nothing is read from disk while rendering
+	for(int i = 0; i < NUM_AUX_TEXTURES; i++) {
+		m->aux_textures[i] = loadTexture(m, aux_texture_paths[i]);
+		t = timeStartup(log, aux_texture_paths[i], t);
+	}
 
-	// Initialize audio
-	Mix_OpenAudio(SAMPLE_RATE, MIX_DEFAULT_FORMAT, NUM_CHANNELS, CHUNK_SIZE);
+	// Draw batches for the HUD and debug overlay. Text waits for the font.
+	loadBatch(&m->batches[BATCH_LINES], NULL);
+	loadBatch(&m->batches[BATCH_DOTS], m->aux_textures[TEX_DBG]);
+	loadBatch(&m->batches[BATCH_COOLDOWN], m->textures[LASER]);
+	loadBatch(&m->batches[BATCH_TEXT], NULL);
 
-	// Load music and set volume
-	music = Mix_LoadMUS("audio/music.wav");
-	Mix_VolumeMusic(100);
-	Mix_PlayMusic(music, -1);
+	// Hitbox templates and initial state
+	loadShapes();
+	newGame(st, seed);
+	timeStartup(log, "initial state", t);
 
-	// Make space for sound effect list
-	sfx = (Mix_Chunk**) malloc(sizeof(Mix_Chunk*) * NUM_SFX);
+	return true;
+}
 
-	// Sound effects
-	sfx[SFX_LASER]  = Mix_LoadWAV("audio/laser.wav");
-	sfx[SFX_CRASH]  = Mix_LoadWAV("audio/crash.wav");
-	sfx[SFX_THRUST] = Mix_LoadWAV("audio/thrust.wav");
-
-	// Initial state
-	double c_x = (double) (SCREEN_WIDTH - ship_w) / 2;
-	double c_y = (double) (SCREEN_HEIGHT - ship_h) / 2;
-	int nbb = 2;
-	SDL_Rect* bb = malloc(sizeof(SDL_Rect) * nbb);
-	bb[0] = (SDL_Rect) { 2, 2, 7, 16 };
-	bb[1] = (SDL_Rect) { 4, 7, 16, 6 };
-	st->ship = loadSprite(SHIP, ship_w, ship_h, c_x, c_y, nbb, bb);
-	st->score = 0;
-	st->laser_cooldown = 0;
-	st->thrust = false;
-
-	// "seed" the linked list with one asteroid - we don't want it to be empty.
-	st->sprites = NULL;
-	ensureAsteroids(st);
+// Wait for the audio and font, make the glyph atlas texture and start the
+// music
+void finishLoading(Media* m, Loader* ld, Startup* log)
+{
+	Uint64 t = SDL_GetPerformanceCounter();
+	pthread_join(ld->thread, NULL);
+	t = timeStartup(log, "wait for loader", t);
 
-	return true;
+	m->atlas.t = SDL_CreateTextureFromSurface(m->renderer, ld->glyphs);
+	SDL_FreeSurface(ld->glyphs);
+	loadBatch(&m->batches[BATCH_TEXT], m->atlas.t);
+	timeStartup(log, "glyph atlas", t);
+
+	Mix_PlayMusic(m->music, -1);
 }
 
-// Destroy a sprite
-void unloadSprite(Sprite* s)
+// Print how long each part of startup took, on each thread, in milliseconds
+// since SDL started loading
+void printStartup(const Startup* logs[], int n)
 {
-	free(s->bb);
-	free(s);
+	double ms = 1000.0 / SDL_GetPerformanceFrequency();
+	printf("%-29s %8s %8s %8s\n", "Startup (ms)", "start", "end", "took");
+	for(int i = 0; i < n; i++) {
+		const Startup* log = logs[i];
+		for(int j = 0; j < log->n; j++) {
+			double start = (log->start[j] - log->origin) * ms;
+			double end = (log->end[j] - log->origin) * ms;
+			printf("%-6s %-22s %8.1f %8.1f %8.1f\n", i ? "loader" : "main",
+					log->what[j], start, end, end - start);
+		}
+	}
 }
 
-// Remove a sprite at the given position in
-// the linked list, and return the next element in the linked list
-SpriteList* unloadSpriteInPlace(State* st, SpriteList* a)
+// Make an empty rewind ring of cap slots, each big enough for a game of up
+// to sprites pool slots
+void startRewind(Rewind* r, int cap, int sprites)
 {
-	if(a->next) a->next->prev = a->prev;
-	if(a->prev) a->prev->next = a->next;
-	else        st->sprites = a->next;
-	unloadSprite(a->sprite);
-	SpriteList* next = a->next;
-	free(a);
-	return next;
+	r->slot = snapshotSize(sprites);
+	r->data = malloc(r->slot * cap);
+	r->cap = cap;
+	r->head = 0;
+	r->count = 0;
 }
 
-// Destroy asteroid linked list
-void unloadSprites(SpriteList* a)
+// Save a snapshot of a game as the newest in the ring, dropping the oldest if
+// the ring is full. Returns false if the game is too big for a slot.
+bool pushRewind(Rewind* r, const State* st)
 {
-	while(a) {
-		unloadSprite(a->sprite);
-		SpriteList* p = a;
-		a = a->next;
-		free(p);
-	}
+	if(snapshotSize(st->sprites.top) > r->slot) return false;
+	saveSnapshot(st, r->data + r->head * r->slot);
+	r->head = (r->head + 1) % r->cap;
+	if(r->count < r->cap) r->count++;
+	return true;
+}
+
+// Restore the newest snapshot in the ring and drop it. Returns false if the
+// ring is empty.
+bool popRewind(Rewind* r, State* st)
+{
+	if(r->count == 0) return false;
+	r->head = (r->head + r->cap - 1) % r->cap;
+	r->count--;
+	return restoreSnapshot(st, r->data + r->head * r->slot);
+}
+
+// Free a rewind ring
+void unloadRewind(Rewind* r)
+{
+	free(r->data);
 }
 
 // Free all resources and quit SDL
-void quitGame(State* st)
+void quitGame(State* st, Media* m)
 {
 	// Free renderer and window
-	SDL_DestroyRenderer(renderer);
-	SDL_DestroyWindow(window);
+	SDL_DestroyRenderer(m->renderer);
+	SDL_DestroyWindow(m->window);
 
 	// Free textures
-	for(int i = 0; i < NUM_SPRITES; i++) SDL_DestroyTexture(textures[i]);
-	free(textures);
+	for(int i = 0; i < NUM_SPRITES; i++) SDL_DestroyTexture(m->textures[i]);
+	for(int i = 0; i < NUM_AUX_TEXTURES; i++) {
+		SDL_DestroyTexture(m->aux_textures[i]);
+	}
+	for(int i = 0; i < NUM_BATCHES; i++) free(m->batches[i].v);
 
 	// Free font elements
-	TTF_CloseFont(font);
+	SDL_DestroyTexture(m->atlas.t);
+	TTF_CloseFont(m->font);
 	TTF_Quit();
 
 	// Free audio elements
-	Mix_FreeMusic(music);
-	for(int i = 0; i < NUM_SFX; i++) Mix_FreeChunk(sfx[i]);
-	free(sfx);
+	Mix_FreeMusic(m->music);
+	for(int i = 0; i < NUM_SFX; i++) Mix_FreeChunk(m->sfx[i]);
 	Mix_Quit();
 
 	// Free state
-	unloadSprite(st->ship);
-	unloadSprites(st->sprites);
+	unloadGame(st);
+
+	// Unmap the asset bundle, now that nothing streams from it
+	closePack(&m->pack);
 
 	// Free SDL
 	SDL_Quit();
 }
 
-Circle makeCircle(const Sprite* s, double radius)
-{
-	Circle circle;
-	circle.x = s->x + ((double) s->w/2);
-	circle.y = s->x + ((double) s->h/2);
-	circle.r = radius;
-	return circle;
-}
-
-bool circleIntersect(Circle c1, Circle c2)
-{
-	double centerDist = sqrt(pow((c1.x - c2.x),2) + pow((c1.y - c2.y),2));
-	return centerDist <= c1.r + c2.r;
-}
-
-// Precisely check if sprites are touching by
-// comparing their arrays of bounding boxes
-bool colliding(const Sprite* s1, const Sprite* s2)
-{
-	// Nested for loop to compare each bounding box pair
-	SDL_Rect* b1 = s1->bb;
-	SDL_Rect* b2 = s2->bb;
-	for(int i = 0; i < s1->nbb; i++) {
-		int x1 = b1[i].x + s1->x;
-		int y1 = b1[i].y + s1->y;
-		for(int j = 0; j < s2->nbb; j++) {
-			int x2 = b2[j].x + s2->x;
-			int y2 = b2[j].y + s2->y;
-
-			// Positions of the points on the rectangles in space
-			int bb1[4][2] = { { x1, y1 }
-			                , { x1 + b1[i].w, y1 }
-			                , { x1, y1 + b1[i].h }
-							, { x1 + b1[i].w, y1 + b1[i].h } };
-			int bb2[4][2] = { { x2, y2 }
-			                , { x2 + b2[j].w, y2 }
-							, { x2, y2 + b2[j].h }
-							, { x2 + b2[j].w, y2 + b2[j].h } };
-
-			// Centers around which each point is rotated
-			double bb1_c[2] = { s1->x + s1->w / 2.0, s1->y + s1->h / 2.0 };
-			double bb2_c[2] = { s2->x + s2->w / 2.0, s2->y + s2->h / 2.0 };
-
-			// Rotated positions for every point
-			double r_bb1[8];
-			double r_bb2[8];
-			for(int k = 0; k < 4; k++) {
-				r_bb1[k * 2 + 0] = bb1_c[0]
-				                 + cos(s1->theta) * (bb1[k][0] - bb1_c[0])
-							     - sin(s1->theta) * (bb1_c[1] - bb1[k][1]);
-				r_bb1[k * 2 + 1] = bb1_c[1]
-				                 - sin(s1->theta) * (bb1[k][0] - bb1_c[0])
-							     - cos(s1->theta) * (bb1_c[1] - bb1[k][1]);
-				r_bb2[k * 2 + 0] = bb2_c[0]
-				                 + cos(s2->theta) * (bb2[k][0] - bb2_c[0])
-							     - sin(s2->theta) * (bb2_c[1] - bb2[k][1]);
-				r_bb2[k * 2 + 1] = bb2_c[1]
-				                 - sin(s2->theta) * (bb2[k][0] - bb2_c[0])
-							     - cos(s2->theta) * (bb2_c[1] - bb2[k][1]);
-			}
-
-			// Separating axis algorithm
-			bool collision = true;
-			for(int k = 0; k < 4; k++) {
-
-				// Get axis vector and bounding box to check it against
-				double* axis_bb = &r_bb1[0];
-				double* other_bb = &r_bb2[0];
-				if(k >= 2) {
-					axis_bb = &r_bb2[0];
-					other_bb = &r_bb1[0];
-				}
-				double axis[4] = { axis_bb[0], axis_bb[1]
-					             , axis_bb[2], axis_bb[3] };
-		        if(k & 1) {
-					axis[2] = axis_bb[4];
-					axis[3] = axis_bb[5];
-				}
-
-				// Project each point in other_bb onto the axis to see if there
-				// is overlap. If there is, we can move on to the next axis. If
-				// there's an axis with no overlap, the boxes aren't colliding
-				bool overlap = false;
-				bool left = false;
-				bool right = false;
-				for(int x = 0; x < 4; x++) {
-					double dx = axis[2] - axis[0];
-    				double dy = axis[3] - axis[1];
-    				double proj = (other_bb[2 * x + 0] - axis[0]) * dx
-					            + (other_bb[2 * x + 1] - axis[1]) * dy;
-					bool proj_left = 0 <= proj;
-					bool proj_right = proj <= dx * dx + dy * dy;
-					if(proj_left) left = true;
-					if(proj_right) right = true;
-					if((!proj_left && !proj_right) || (left && right)) {
-						overlap = true;
-						break;
-					}
-				}
-				if(!overlap) {
-					collision = false;
-					break;
-				}
-			}
-
-			if(collision) {
-#ifdef CBMC
-				// Overapproximation
-				Circle circle1 = makeCircle(s1, max(s1->w, s1->h));
-				Circle circle2 = makeCircle(s2, max(s2->w, s2->h));
-				__CPROVER_assert(circleIntersect(circle1, circle2),
-						"Colliding -- overapproximation should also collide!");
-#endif // CBMC
-				return true;
-			}
-		}
+void renderBounds(Media* m, const Hitbox* hb, double x, double y)
+{
+	// For each box, queue 4 lines to create the rectangle
+	Batch* lines = &m->batches[BATCH_LINES];
+	SDL_Color green = { 0, 0xFF, 0, 0xFF };
+	for(int i = 0; i < hb->n; i++) {
+		const double* rb = hb->corners[i];
+		batchLine(lines, rb[0], rb[1], rb[2], rb[3], green);
+		batchLine(lines, rb[2], rb[3], rb[6], rb[7], green);
+		batchLine(lines, rb[6], rb[7], rb[4], rb[5], green);
+		batchLine(lines, rb[4], rb[5], rb[0], rb[1], green);
 	}
-#ifdef CBMC
-	// Underapproximation
-	Circle circle1 = makeCircle(s1, s1->r);
-	Circle circle2 = makeCircle(s2, s2->r);
-	__CPROVER_assert(!circleIntersect(circle1, circle2),
-			"Not colliding -- underapproximation should not collide!");
-#endif // CBMC
-	return false;
+
+	SDL_Rect clip = { 5, 5, 2, 2 };
+	SDL_Rect quad = { x, y, 2, 2 };
+	batchCopy(&m->batches[BATCH_DOTS], &clip, &quad, false);
 }
 
-bool isLaser(const Sprite* s)
+// Render a single sprite
+void renderSprite(Media* m, int id, int w, int h, double x, double y,
+		double theta, const Hitbox* hb)
 {
-	return s->id == LASER;
+	SDL_Rect src = { 0, 0, w, h };
+	SDL_Rect dst = { (int) x, (int) y, w, h };
+	double rot = -theta * (180.0 / M_PI);
+	SDL_RenderCopyEx(m->renderer, m->textures[id], &src, &dst, rot, NULL,
+			SDL_FLIP_NONE);
+	if(m->debug) renderBounds(m, hb, x, y);
 }
 
-bool isRock(const Sprite* s)
+// Render a line of text with its top left corner at (x, y), one quad from the
+// glyph atlas per character. Characters missing from the atlas are skipped.
+void renderText(Media* m, const char* text, int x, int y)
 {
-	return (s->id == ASTER || s->id == FRAGMENT);
+	const GlyphAtlas* atlas = &m->atlas;
+	for(const char* c = text; *c; c++) {
+		if(*c < FIRST_GLYPH || *c > LAST_GLYPH) continue;
+		int g = *c - FIRST_GLYPH;
+		int w = atlas->x[g + 1] - atlas->x[g];
+		SDL_Rect src = { atlas->x[g], 0, w, atlas->h };
+		SDL_Rect dst = { x, y, w, atlas->h };
+		batchCopy(&m->batches[BATCH_TEXT], &src, &dst, false);
+		x += w;
+	}
 }
 
-bool detectAllCollisions(State* st)
+// Render the current score
+void renderScore(Media* m, long long score)
 {
-	// Hash map of sprites marked for deletion
-	int len = 0;
-	for(SpriteList* a = st->sprites; a != NULL; a = a->next, len++);
-
-	bool delete[len];
-	for (int i=0; i < len; i++) delete[i] = false;
-
-	// Detect any collisions and mark sprites for deletion
-	int i = 0;
-	for(SpriteList* a = st->sprites; a != NULL; a = a->next, i++) {
-		Sprite* s1 = a->sprite;
+	char score_str[100];
+	sprintf(score_str, "Score: %010llu", score);
+	renderText(m, score_str, 20, 20);
+}
 
-		// N^2 check
-		int j = i + 1;
-		for(SpriteList* b = a->next; b != NULL; b = b->next, j++) {
-			Sprite* s2 = b->sprite;
+// Render a bar representing the cooldown of the laser
+void renderCooldown(Media* m, int cd)
+{
+	Batch* line = &m->batches[BATCH_COOLDOWN];
+	int w = 2;
+	int h = 12;
+	int y = 50;
+	for(int i = 0; i < cd; i++) {
+		int x = 20 + i * 2;
+		SDL_Rect src = { 0, 0, w, h };
+		SDL_Rect dst = { x, y, w, h };
+		batchCopy(line, &src, &dst, true);
+	}
+}
 
-			bool laserHit = (isRock(s1) && isLaser(s2))
-				|| (isRock(s2) && isLaser(s1));
-			bool asteroidsCollide = isRock(s1) && isRock(s2);
+// Render a little flame behind the ship when it's accelerating
+void renderThrust(Media* m, const Sprite* ship, double x, double y, double t)
+{
+	int th_w = 10;
+	int th_h = 8;
 
-			if((laserHit || asteroidsCollide)
-					&& colliding(s1, s2) && !delete[i] && !delete[j]) {
-				delete[i] = true;
-				delete[j] = true;
-				playSfx(SFX_CRASH, 200);
-				if (laserHit) {
-					st->score += 50;
-				}
-			}
-		}
+	int w = ship->w;
+	int h = ship->h;
+	int th_x = x + w/2 + ((-w/2 - 4) * cos(t)) - th_w/2;
+	int th_y = y + h/2 - ((-w/2 - 4) * sin(t)) - th_h/2;
 
-		// Rock-ship collisions end the game
-		if(isRock(s1) && colliding(st->ship, s1)) {
-			return true;
-		}
-	}
+	SDL_Rect src = { 0, 0, th_w, th_h };
+	SDL_Rect dst = { th_x, th_y, th_w, th_h };
+	double rot = -t * (180.0 / M_PI);
 
-	// Delete marked sprites and exit
-	int n = 0;
+	SDL_Texture* tex = m->aux_textures[TEX_THRUST];
+	SDL_RenderCopyEx(m->renderer, tex, &src, &dst, rot, NULL, SDL_FLIP_NONE);
+}
 
-	for(SpriteList* a = st->sprites; a != NULL; n++) {
-#ifdef CBMC
-		__CPROVER_assert(n <= len, "Array access out of bounds!");
-#endif // CBMC
-		if(delete[n]) {
-			if(a->sprite->id == ASTER) breakAsteroid(st, a->sprite);
-			a = unloadSpriteInPlace(st, a);
-		}
-		else {
-			a = a->next;
-		}
-	}
-	return false;
+// Value a fraction alpha of the way from a to b. A jump of more than span,
+// like the ship wrapping across the screen, is drawn at b straight away.
+double lerp(double a, double b, double alpha, double span)
+{
+	if(fabs(b - a) > span) return b;
+	return a + (b - a) * alpha;
 }
 
-// Move the ship through space according to our "laws" of physics each frame
-void moveShip(State* st, const Uint8* keys)
+// Draw a frame a fraction alpha of the way through the step that led to it
+void renderGame(Media* m, const Frame* f, double alpha, Profile* prof)
 {
-	Sprite* s = st->ship;
+	PROFILE_BEGIN(prof, PHASE_DRAW_SPRITES);
 
-	// Ship parameters
-	double thrust = 0.08;
-	double thrust_damp = 0.99;
-	double torque = 0.004;
-	double torque_damp = 0.95;
+	// Ship
+	const Sprite* ship = &f->ship;
+	double x = lerp(ship->px, ship->x, alpha, SCREEN_WIDTH / 2);
+	double y = lerp(ship->py, ship->y, alpha, SCREEN_HEIGHT / 2);
+	double t = lerp(ship->ptheta, ship->theta, alpha, INFINITY);
+	renderSprite(m, ship->id, ship->w, ship->h, x, y, t, &ship->hb);
 
-	// Damping force based on velocity (simulates friction / resistance)
-	s->dx *= thrust_damp;
-	s->dy *= thrust_damp;
-	s->omega *= torque_damp;
+	if(f->thrust) renderThrust(m, ship, x, y, t);
 
-	// Apply forces based on keystate
-	if (keys[SDL_SCANCODE_UP]) {
-		st->thrust = true;
-		if(thrust_ch == -1) {
-			thrust_ch = Mix_PlayChannel(-1, sfx[SFX_THRUST], -1);
-		}
-		s->dx += thrust * cos(s->theta);
-		s->dy -= thrust * sin(s->theta);
-	}
-	else {
-		st->thrust = false;
-		if(thrust_ch != -1) {
-			Mix_HaltChannel(thrust_ch);
-			thrust_ch = -1;
-		}
-	}
-	if (keys[SDL_SCANCODE_LEFT]) {
-		s->omega += torque;
-	}
-	if (keys[SDL_SCANCODE_RIGHT]) {
-		s->omega -= torque;
+	// Sprites
+	for(int i = 0; i < f->n; i++) {
+		const Sprite* s = &f->sprites[i];
+		x = lerp(s->px, s->x, alpha, INFINITY);
+		y = lerp(s->py, s->y, alpha, INFINITY);
+		t = lerp(s->ptheta, s->theta, alpha, INFINITY);
+		renderSprite(m, s->id, s->w, s->h, x, y, t, &s->hb);
 	}
+	PROFILE_END(prof, PHASE_DRAW_SPRITES);
 
-	// Propagate to derived quantities
-	s->x += s->dx;
-	s->y += s->dy;
-	s->theta += s->omega;
+	// Score, once the font has loaded
+	PROFILE_BEGIN(prof, PHASE_DRAW_HUD);
+	if(m->atlas.t) renderScore(m, f->score);
 
-	// Screen wrap
-	if(s->x > SCREEN_WIDTH)  s->x = 0 - s->w;
-	if(s->y > SCREEN_HEIGHT) s->y = 0 - s->h;
-	if(s->x < 0 - s->w)      s->x = SCREEN_WIDTH;
-	if(s->y < 0 - s->h)      s->y = SCREEN_HEIGHT;
+	// Laser cooldown bar
+	renderCooldown(m, f->laser_cooldown);
+	PROFILE_END(prof, PHASE_DRAW_HUD);
 
-#ifdef CBMC
-	bool xInBound = -s->w <= s->x && s->x <= SCREEN_WIDTH + s->w;
-	bool yInBound = -s->h <= s->y && s->y <= SCREEN_HEIGHT + s->h;
-	__CPROVER_assert(xInBound && yInBound, "Out of Bounds!");
-#endif // CBMC
+	// Draw the HUD and debug overlay queued above, one call per batch
+	PROFILE_BEGIN(prof, PHASE_FLUSH);
+	for(int i = 0; i < NUM_BATCHES; i++) flushBatch(m->renderer, &m->batches[i]);
+	PROFILE_END(prof, PHASE_FLUSH);
 }
 
-// Move the asteroids through space according to "laws" of physics each frame
-// No forces are applied to asteroids, they just travel through space.
-// They don't wrap around the screen either.
-void moveSprites(State* st)
+// Copy what is needed to draw the state into a frame, stamped with the time
+// the state's step was due. Hitboxes are only copied when they'll be drawn.
+void makeFrame(Frame* f, const State* st, Uint64 time, bool hitboxes)
 {
-	for(SpriteList* a = st->sprites; a != NULL; a = a->next) {
-		Sprite* s = a->sprite;
-		s->x += s->dx;
-		s->y += s->dy;
-		s->theta += s->omega;
+	f->score = st->score;
+	f->laser_cooldown = st->laser_cooldown;
+	f->thrust = st->thrust;
+	f->time = time;
+	f->ship = st->ship;
+
+	const SpritePool* p = &st->sprites;
+	if(f->cap < p->n) {
+		f->cap = p->cap;
+		f->sprites = realloc(f->sprites, sizeof(Sprite) * f->cap);
+	}
+	f->n = 0;
+	for(int i = 0; i < p->top; i++) {
+		if(!p->alive[i]) continue;
+		Sprite* s = &f->sprites[f->n++];
+		s->id = p->id[i];
+		s->w = p->w[i];
+		s->h = p->h[i];
+		s->x = p->x[i];
+		s->y = p->y[i];
+		s->theta = p->theta[i];
+		s->px = p->px[i];
+		s->py = p->py[i];
+		s->ptheta = p->ptheta[i];
+		if(hitboxes) s->hb = p->hb[i];
 	}
 }
 
-// There is a chance of spawning a new asteroid each frame, randomly placed,
-// if there are less than the maximum number of asteroids out already
-void checkSpawnAsteroid(State* st)
+// Hand the writer's frame over to the reader, taking back whichever frame
+// was in the middle. Returns the frame to write next.
+Frame* publishFrame(TripleBuffer* tb)
 {
-#ifdef CBMC
-	__CPROVER_precondition(st->sprites != NULL, "There are always asteroids.");
-#endif //CBMC
-
-	// Controls how many asteroids are on screen
-	double spawn_chance = 0.05;
-	int n_ast = st->score / 1000 + 3;
+	int mid = __atomic_exchange_n(&tb->mid, tb->back | FRAME_FRESH,
+			__ATOMIC_ACQ_REL);
+	tb->back = mid & ~FRAME_FRESH;
+	return &tb->frames[tb->back];
+}
 
-	// Count asteroids
-	double n = 0;
-	for(SpriteList* a = st->sprites; a != NULL; a = a->next) {
-		if(a->sprite->id == ASTER) n += 1.0;
-		if(a->sprite->id == FRAGMENT) n += 0.25;
+// Latest frame the writer has published. The reader keeps drawing the same
+// frame until a newer one comes in; fresh says whether this one is new.
+const Frame* latestFrame(TripleBuffer* tb, bool* fresh)
+{
+	*fresh = __atomic_load_n(&tb->mid, __ATOMIC_ACQUIRE) & FRAME_FRESH;
+	if(*fresh) {
+		int mid = __atomic_exchange_n(&tb->mid, tb->front, __ATOMIC_ACQ_REL);
+		tb->front = mid & ~FRAME_FRESH;
 	}
-
-	// If we're under capacity, chance to append new asteroid to list
-	if(n < n_ast && getRand() < spawn_chance) addSprite(st, spawnAsteroid(st));
-
-#ifdef CBMC
-	// There should still be asteroids after the fact
-	__CPROVER_postcondition(st->sprites != NULL, "Must be > 0 asteroids");
-#endif //CBMC
+	return &tb->frames[tb->front];
 }
 
-// Handles garbage collection of asteroids after they've left the screen
-void checkDespawnSprites(State* st)
+void unloadFrames(TripleBuffer* tb)
 {
-	// How far off screen a sprite should be before it is despawned
-	int radius = 100;
+	for(int i = 0; i < 3; i++) free(tb->frames[i].sprites);
+}
 
-	// Iterate over all sprites
-	SpriteList* a = st->sprites;
-	while(a) {
+// Turn the keyboard state into player input bits
+int readInput(const Uint8* keys)
+{
+	int input = 0;
+	if(keys[SDL_SCANCODE_UP])    input |= INPUT_UP;
+	if(keys[SDL_SCANCODE_LEFT])  input |= INPUT_LEFT;
+	if(keys[SDL_SCANCODE_RIGHT]) input |= INPUT_RIGHT;
+	if(keys[SDL_SCANCODE_SPACE]) input |= INPUT_FIRE;
+	return input;
+}
 
-		// Check if the sprite is off screen and remove it
-		Sprite* s = a->sprite;
-		if(s->x > SCREEN_WIDTH  + radius || s->x + s->w < 0 - radius ||
-				s->y > SCREEN_HEIGHT + radius || s->y + s->h < 0 - radius) {
-			a = unloadSpriteInPlace(st, a);
-		}
-		else {
-			a = a->next;
-		}
-	}
+// Scripted players for headless runs
+enum policies
+{ POLICY_THRUST, POLICY_IDLE, POLICY_SPIN, POLICY_RANDOM, NUM_POLICIES };
+const char* policy_names[NUM_POLICIES] = { "thrust", "idle", "spin", "random" };
 
-	// If there are no sprites left, force an asteroid to spawn
-	// (linked list should never be empty)
-	ensureAsteroids(st);
+// A scripted player. The random player keeps its own xorshift state, so it
+// never disturbs the game's random numbers.
+typedef struct Player
+{
+	int policy;
+	unsigned rng;
+	int held;
 }
+Player;
 
-void fireLaser(State* st)
+// Input a scripted player gives on a frame
+int playerInput(Player* pl, long frame)
 {
-	// Laser data. Velocity is at least 4, but in general is a little higher
-	// than the ship's velocity, so the ship can never outrun its own lasers
-	Sprite* ship = st->ship;
-	int l_w = 2;
-	int l_h = 12;
-	int l_v = max(6, 2 + sqrt(ship->dx * ship->dx + ship->dy * ship->dy));
+	switch(pl->policy) {
+		case POLICY_THRUST: return INPUT_UP | INPUT_FIRE;
+		case POLICY_IDLE:   return 0;
+		case POLICY_SPIN:   return INPUT_LEFT | INPUT_FIRE;
+		default:            break;
+	}
 
-	// Stupid bullshit to line up the position of the (rotated) laser with the
-	// (rotated) nose of the ship. Don't ask how I derived this.
-	int w = ship->w;
-	int h = ship->h;
-	double t = ship->theta;
-	int l_x = ship->x + (w * (1 + cos(t)) + l_h * sin(t + M_PI_2)) / 2;
-	int l_y = ship->y + (h - w * sin(t) - l_h * (1 - cos(t + M_PI_2))) / 2;
-
-	// Spawn laser and set its direction and velocity
-	int nbb = 1;
-	SDL_Rect* bb = malloc(sizeof(SDL_Rect) * nbb);
-	bb[0] = (SDL_Rect) { 0, 0, 2, 12 };
-	Sprite* lz = loadSprite(LASER, l_w, l_h, l_x, l_y, nbb, bb);
-	lz->theta = t + M_PI_2;
-	lz->dx = l_v *  cos(t);
-	lz->dy = l_v * -sin(t);
-
-	// Add laser to head of linked list of active sprites
-	addSprite(st, lz);
-
-	// Laser sound effect
-	playSfx(SFX_LASER, 250);
-
-	/* Ship is never faster than the laser. */
-	/* What a terrible engineering feat it would be if this were true! */
-#ifdef CBMC
-	__CPROVER_assert(abs(st->ship->dx) <= abs(lz->dx),
-			"Ship dx faster than laser!");
-	__CPROVER_assert(abs(st->ship->dy) <= abs(lz->dy),
-			"Ship dy faster than laser!");
-#endif // CBMC
-}
-
-void updateLasers(State* st, const Uint8* keys)
-{
-	if(st->laser_cooldown > 0) st->laser_cooldown--;
-	if(st->laser_cooldown == 0 && keys[SDL_SCANCODE_SPACE]) {
-		st->laser_cooldown = 50 - st->score / 400;
-		fireLaser(st);
+	// Random player holds a random set of keys for 10 frames at a time
+	if(frame % 10 == 0) {
+		pl->rng ^= pl->rng << 13;
+		pl->rng ^= pl->rng >> 17;
+		pl->rng ^= pl->rng << 5;
+		pl->held = pl->rng & (INPUT_UP | INPUT_LEFT | INPUT_RIGHT | INPUT_FIRE);
 	}
+	return pl->held;
 }
 
-// Use keyboard state to update the game state
-bool updateGame(State* st, const Uint8* keys)
+// Wall clock time in seconds
+double now(void)
 {
-	// Ship moves
-	moveShip(st, keys);
+	struct timeval tm;
+	gettimeofday(&tm, NULL);
+	return tm.tv_sec + tm.tv_usec / 1000000.0;
+}
 
-	// Asteroids and lasers move
-	moveSprites(st);
+// Simulate frames of play with a scripted player, with no window, audio or
+// frame cap, starting a new game whenever the ship is destroyed. Each game is
+// seeded from a stream started at seed, so a run is repeatable bit for bit.
+// Prints the simulation speed and the most sprites that were alive at once.
+// Each of the frames is an update covering step frames of motion. Frames are
+// recorded into prof, if it isn't NULL, and collision detection is shared
+// with workers, if it isn't NULL.
+void runHeadless(uint64_t seed, long frames, int policy, int step,
+		Profile* prof, Workers* workers)
+{
+	Rng seeds;
+	seedRng(&seeds, seed);
+	Player pl = { policy, seed * 2654435761u + 1, 0 };
+	loadShapes();
 
-	// Collision detection and resolution
-	// Returns true if the ship hit an asteroid
-	if(detectAllCollisions(st)) return true;
+	State st;
+	newGame(&st, nextRng(&seeds));
+	st.step = step;
+	st.prof = prof;
+	st.workers = workers;
+	long games = 1;
+	long long best = 0;
+	int peak = st.sprites.n;
+
+	double start = now();
+	for(long f = 0; f < frames; f++) {
+		if(updateGame(&st, playerInput(&pl, f))) {
+			best = max(best, st.score);
+			unloadGame(&st);
+			newGame(&st, nextRng(&seeds));
+			st.step = step;
+			st.prof = prof;
+			st.workers = workers;
+			games++;
+		}
+		PROFILE_FRAME(prof);
+		peak = max(peak, st.sprites.n);
+	}
+	double secs = now() - start;
+	best = max(best, st.score);
+	unloadGame(&st);
+
+	printf("Simulated %ld frames (%ld games) in %.3f s\n", frames, games, secs);
+	printf("Frames per second: %.0f\n", frames / max(secs, 1e-9));
+	if(step > 1) {
+		printf("Game frames per second: %.0f (%d per frame)\n",
+				frames * step / max(secs, 1e-9), step);
+	}
+	printf("Peak sprite count: %d\n", peak);
+	printf("Best score: %lld\n", best);
+}
 
-	// Laser cooldown, check if player wants to fire a laser
-	updateLasers(st, keys);
+// Play a recorded game back with no window, audio or frame cap, feeding the
+// recorded input to updateGame frame by frame. Prints how long the game ran
+// for, its final score and the simulation speed.
+void runReplay(Recording* rec, Profile* prof)
+{
+	loadShapes();
+	State st;
+	newGame(&st, rec->seed);
+	st.prof = prof;
+
+	long f = 0;
+	bool dead = false;
+	int input;
+	double start = now();
+	while(!dead && (input = replayInput(rec)) >= 0) {
+		dead = updateGame(&st, input);
+		PROFILE_FRAME(prof);
+		f++;
+	}
+	double secs = now() - start;
 
-	// When a sprite goes off screen, it is despawned
-	checkDespawnSprites(st);
+	printf("Replayed %ld of %ld frames in %.3f s\n", f, rec->frames, secs);
+	printf("Frames per second: %.0f\n", f / max(secs, 1e-9));
+	printf("%s\n", dead ? "Ship destroyed" : "Ship survived");
+	printf("Final score: %lld\n", st.score);
+	unloadGame(&st);
+}
 
-	// Each frame, a new asteroid might spawn
-	checkSpawnAsteroid(st);
+// Many independent headless games, each capped at a number of frames
+typedef struct Run
+{
+	long frames;
+	int policy;
+	int step;
+	uint64_t* seeds;
+	long long* scores;
+	long* lengths;
+}
+Run;
 
-	// Score goes up by 1 per frame
-	st->score++;
+// Play one game of a run to the end or to the frame cap, on any of the
+// worker threads (see State)
+void playGame(void* arg, int index, int worker)
+{
+	Run* run = arg;
+	uint64_t seed = run->seeds[index];
+	Player pl = { run->policy, (unsigned) seed | 1, 0 };
 
-	return false;
+	State st;
+	newGame(&st, seed);
+	st.step = run->step;
+	long f = 0;
+	bool dead = false;
+	while(f < run->frames && !dead) dead = updateGame(&st, playerInput(&pl, f++));
+	run->scores[index] = st.score;
+	run->lengths[index] = f;
+	unloadGame(&st);
 }
 
-void renderBounds(const Sprite* s)
+int compareScores(const void* a, const void* b)
 {
-	// For each box, render 4 lines to create the rectangle
-	SDL_Texture* tex = loadTexture("graphics/dbg.bmp");
-	SDL_Rect* bb = s->bb;
-	SDL_SetRenderDrawColor(renderer, 0, 0xFF, 0, 0xFF);
-	for(int i = 0; i < s->nbb; i++) {
+	long long x = *(const long long*) a;
+	long long y = *(const long long*) b;
+	return (x > y) - (x < y);
+}
 
-		// Positions of the points on the rectangle in space
-		int x1 = bb[i].x + s->x;
-		int y1 = bb[i].y + s->y;
-		int bb1[4][2] = { { x1, y1 }
-						, { x1 + bb[i].w, y1 }
-						, { x1, y1 + bb[i].h }
-						, { x1 + bb[i].w, y1 + bb[i].h } };
+// Play games independent headless games across a pool of worker threads and
+// print games per second and the spread of final scores. Game seeds are drawn
+// up front from a stream started at seed, so every game's result is the same
+// whatever the number of threads.
+void runBatch(uint64_t seed, long games, long frames, int policy, int step,
+		int threads)
+{
+	Run run = { frames, policy, step };
+	run.seeds = malloc(sizeof(uint64_t) * games);
+	run.scores = malloc(sizeof(long long) * games);
+	run.lengths = malloc(sizeof(long) * games);
+
+	Rng seeds;
+	seedRng(&seeds, seed);
+	for(long i = 0; i < games; i++) run.seeds[i] = nextRng(&seeds);
+	loadShapes();
+
+	Workers* w = startWorkers(threads);
+	double start = now();
+	runTasks(w, games, playGame, &run);
+	double secs = max(now() - start, 1e-9);
+
+	long long total_frames = 0;
+	double mean = 0;
+	for(long i = 0; i < games; i++) {
+		total_frames += run.lengths[i];
+		mean += (double) run.scores[i] / games;
+	}
+	qsort(run.scores, games, sizeof(long long), compareScores);
+	long long* sc = run.scores;
+	long last = games - 1;
+
+	printf("Played %ld games (%lld frames) on %d threads in %.3f s\n", games,
+			total_frames, w->n, secs);
+	printf("Games per second: %.1f\n", games / secs);
+	printf("Frames per second: %.0f\n", total_frames / secs);
+	printf("Ranges stolen: %ld\n", countSteals(w));
+	printf("Scores: min %lld, p10 %lld, p25 %lld, median %lld, p75 %lld, "
+			"p90 %lld, max %lld, mean %.1f\n", sc[0], sc[last / 10],
+			sc[last / 4], sc[last / 2], sc[last * 3 / 4], sc[last * 9 / 10],
+			sc[last], mean);
+
+	stopWorkers(w);
+	free(run.seeds);
+	free(run.scores);
+	free(run.lengths);
+}
 
-		// Center around which each point is rotated
-		double bb1_c[2] = { s->x + s->w / 2.0, s->y + s->h / 2.0 };
+// Benchmark scenarios. Each starts a game from the same seed and, bypassing
+// the spawn cap, lays asteroids out at rest on a jittered lattice, fires
+// lasers from the ship all the way round, and breaks asteroids into
+// fragments at random over the screen. Then it plays frames with a scripted
+// player and an invincible ship. Lattice asteroids are far enough apart that
+// none touch however they turn, and the world grows past the screen to fit
+// them. In a fixed scenario no asteroids spawn either, so n rocks stay n
+// rocks for as long as it runs.
+#define BENCH_SEED 1
+#define BENCH_JITTER 8
+#define BENCH_REPEATS 5
+#define BENCH_PHASES (PHASE_SPAWN + 1)
+typedef struct Scenario
+{
+	const char* name;
+	int rocks;
+	int lasers;
+	int breaks;
+	long frames;
+	int policy;
+	bool fixed;
+}
+Scenario;
+
+#define NUM_SCENARIOS 7
+static const Scenario scenarios[NUM_SCENARIOS] = {
+	{ "rocks-10",       10,    0,    0,   30000, POLICY_IDLE,   true },
+	{ "rocks-100",      100,   0,    0,   5000,  POLICY_IDLE,   true },
+	{ "rocks-1k",       1000,  0,    0,   1000,  POLICY_IDLE,   true },
+	{ "rocks-10k",      10000, 0,    0,   300,   POLICY_IDLE,   true },
+	{ "lasers",         100,   2000, 0,   300,   POLICY_SPIN,   false },
+	{ "fragment-storm", 0,     0,    500, 300,   POLICY_IDLE,   false },
+	{ "soak",           0,     0,    0,   50000, POLICY_RANDOM, false }
+};
+
+// Timings of one scenario, in nanoseconds per frame
+typedef struct BenchResult
+{
+	double update;
+	double phases[BENCH_PHASES];
+	int peak;
+}
+BenchResult;
 
-		// Rotated positions for every point
-		double rb[4][2];
-		for(int k = 0; k < 4; k++) {
-			rb[k][0] = bb1_c[0]
-					 + cos(s->theta) * (bb1[k][0] - bb1_c[0])
-					 - sin(s->theta) * (bb1_c[1] - bb1[k][1]);
-			rb[k][1] = bb1_c[1]
-				     - sin(s->theta) * (bb1[k][0] - bb1_c[0])
-					 - cos(s->theta) * (bb1_c[1] - bb1[k][1]);
-		}
-        SDL_RenderDrawLine(renderer, rb[0][0], rb[0][1], rb[1][0], rb[1][1]);
-		SDL_RenderDrawLine(renderer, rb[1][0], rb[1][1], rb[3][0], rb[3][1]);
-		SDL_RenderDrawLine(renderer, rb[3][0], rb[3][1], rb[2][0], rb[2][1]);
-		SDL_RenderDrawLine(renderer, rb[2][0], rb[2][1], rb[0][0], rb[0][1]);
+// Set up a scenario's game
+void setupScenario(State* st, const Scenario* sc)
+{
+	newGame(st, BENCH_SEED);
+	st->invincible = true;
+	st->no_spawns = sc->fixed;
+	Rng* rng = &st->rng;
+
+	// Lattice with the screen's proportions, in a world at least as big as
+	// the screen, with the ship in the middle
+	const Shape* sh = &shapes[ASTER];
+	double pitch = ceil(2 * sh->radius) + 2 * BENCH_JITTER + 1;
+	int cols = max(ceil(sqrt((double) sc->rocks * SCREEN_WIDTH / SCREEN_HEIGHT)),
+			1);
+	int rows = (sc->rocks + cols - 1) / cols;
+	st->width = max(SCREEN_WIDTH, cols * pitch);
+	st->height = max(SCREEN_HEIGHT, rows * pitch);
+	st->ship.x = (st->width - st->ship.w) / 2.0;
+	st->ship.y = (st->height - st->ship.h) / 2.0;
+	updateSpriteHitbox(&st->ship);
+
+	// The lattice takes the place of the game's first asteroid
+	if(sc->rocks > 0) removeSprite(&st->sprites, 0);
+	for(int i = 0; i < sc->rocks; i++) {
+		double jx = (getRand(rng) * 2 - 1) * BENCH_JITTER;
+		double jy = (getRand(rng) * 2 - 1) * BENCH_JITTER;
+		double cx = (i % cols + 0.5) * pitch + jx;
+		double cy = (i / cols + 0.5) * pitch + jy;
+		Sprite a = loadSprite(ASTER, cx - sh->w / 2.0, cy - sh->h / 2.0);
+		a.theta = getRand(rng) * 2 * M_PI;
+		addSprite(&st->sprites, a);
 	}
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+	for(int i = 0; i < sc->lasers; i++) {
+		st->ship.theta = 2 * M_PI * i / sc->lasers;
+		fireLaser(st);
+	}
+	st->ship.theta = 0;
+	for(int i = 0; i < sc->breaks; i++) {
+		Sprite a = spawnAsteroid(st);
+		a.x = getRand(rng) * (SCREEN_WIDTH - a.w);
+		a.y = getRand(rng) * (SCREEN_HEIGHT - a.h);
+		breakAsteroid(st, &a);
+	}
+}
 
-	SDL_Rect clip = { 5, 5, 2, 2 };
-	SDL_Rect quad = { s->x, s->y, 2, 2 };
-	SDL_RenderCopyEx(renderer, tex, &clip, &quad, 0, NULL, SDL_FLIP_NONE);
+// Play a scenario from the start with a scripted player, filling in the
+// peak sprite count and, with prof, the time of each phase. Returns ns per
+// frame.
+double playScenario(const Scenario* sc, Profile* prof, BenchResult* res)
+{
+	State st;
+	setupScenario(&st, sc);
+	st.prof = prof;
+	Player pl = { sc->policy, BENCH_SEED, 0 };
+	if(prof) memset(prof->totals, 0, sizeof(prof->totals));
+
+	int peak = st.sprites.n;
+	double start = now();
+	for(long f = 0; f < sc->frames; f++) {
+		updateGame(&st, playerInput(&pl, f));
+		PROFILE_FRAME(prof);
+		peak = max(peak, st.sprites.n);
+	}
+	double ns = (now() - start) * 1e9 / sc->frames;
+	unloadGame(&st);
 
-	SDL_DestroyTexture(tex);
+	res->peak = peak;
+	for(int i = 0; prof && i < BENCH_PHASES; i++) {
+		res->phases[i] = prof->totals[i] * 1e3 / sc->frames;
+	}
+	return ns;
 }
 
-// Render a single sprite
-void renderSprite(const Sprite* s)
+// Time a scenario BENCH_REPEATS times with the profiler off and keep the
+// fastest run, then, with prof, play it once more to time its phases
+BenchResult runScenario(const Scenario* sc, Profile* prof)
 {
-	SDL_Rect src = { 0, 0, s->w, s->h };
-	SDL_Rect dst = { (int) s->x, (int) s->y, s->w, s->h };
-	double rot = -s->theta * (180.0 / M_PI);
-	SDL_RenderCopyEx(renderer, s->t, &src, &dst, rot, NULL, SDL_FLIP_NONE);
-	if(debug) renderBounds(s);
+	BenchResult best = { INFINITY };
+	for(int r = 0; r < BENCH_REPEATS; r++) {
+		best.update = fmin(best.update, playScenario(sc, NULL, &best));
+	}
+	if(prof) playScenario(sc, prof, &best);
+	return best;
 }
 
-// Render the current score
-void renderScore(long long score)
+// Update time of a scenario in a baseline written by writeBench, or a
+// negative number if the baseline doesn't have it
+double baselineTime(const char* json, const char* name)
 {
-	char score_str[100];
-	sprintf(score_str, "Score: %010llu", score);
-	SDL_Color white = { 255, 255, 255 };
-	SDL_Surface* sMsg = TTF_RenderText_Solid(font, score_str, white);
-	SDL_Texture* tMsg = SDL_CreateTextureFromSurface(renderer, sMsg);
-	SDL_Rect rMsg = { 20, 20, 200, 24 };
-	SDL_RenderCopy(renderer, tMsg, NULL, &rMsg);
-	SDL_FreeSurface(sMsg);
-	SDL_DestroyTexture(tMsg);
+	// Scenarios start lines of their own, unlike phases of the same name
+	char key[64];
+	snprintf(key, sizeof(key), "\n  \"%s\":", name);
+	const char* s = strstr(json, key);
+	if(!s) return -1;
+	s = strstr(s, "\"update_ns\":");
+	if(!s) return -1;
+	return strtod(s + strlen("\"update_ns\":"), NULL);
 }
 
-// Render a bar representing the cooldown of the laser
-void renderCooldown(int cd)
+// Write every scenario's results as a baseline, with phase times if they
+// were taken
+bool writeBench(const char* path, const BenchResult* res, bool phases)
 {
-	SDL_Texture* line = textures[LASER];
-	int w = 2;
-	int h = 12;
-	int y = 50;
-	for(int i = 0; i < cd; i++) {
-		int x = 20 + i * 2;
-		SDL_Rect src = { 0, 0, w, h };
-		SDL_Rect dst = { x, y, w, h };
-		SDL_RenderCopyEx(renderer, line, &src, &dst, 180, NULL, SDL_FLIP_NONE);
+	FILE* f = fopen(path, "w");
+	if(!f) return false;
+	fprintf(f, "{\n");
+	for(int i = 0; i < NUM_SCENARIOS; i++) {
+		const Scenario* sc = &scenarios[i];
+		fprintf(f, "  \"%s\": { \"frames\": %ld, \"peak_sprites\": %d, "
+				"\"update_ns\": %.1f", sc->name, sc->frames, res[i].peak,
+				res[i].update);
+		if(phases) {
+			fprintf(f, ", \"phases_ns\": {");
+			for(int k = 0; k < BENCH_PHASES; k++) {
+				fprintf(f, "%s \"%s\": %.1f", k ? "," : "", phaseName(k),
+						res[i].phases[k]);
+			}
+			fprintf(f, " }");
+		}
+		fprintf(f, " }%s\n", i + 1 < NUM_SCENARIOS ? "," : "");
 	}
+	fprintf(f, "}\n");
+	return fclose(f) == 0;
 }
 
-// Render a little flame behind the ship when it's accelerating
-void renderThrust(const Sprite* ship)
+// Run every benchmark scenario and print ns per frame for updateGame, and
+// for each of its phases in a build with the profiler. Fail if a fixed scenario's rock count ever changes.
+// With a baseline, also print the change in update time and fail if any
+// scenario is more than threshold percent slower. With out, save the results
+// as a new baseline. Returns the exit status.
+int runBench(const char* baseline, double threshold, const char* out)
 {
-	int th_w = 10;
-	int th_h = 8;
+	char* json = NULL;
+	if(baseline) {
+		FILE* f = fopen(baseline, "rb");
+		if(!f) {
+			fprintf(stderr, "Error: Can't read baseline %s\n", baseline);
+			return 1;
+		}
+		fseek(f, 0, SEEK_END);
+		long n = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		json = calloc(n + 1, 1);
+		if(fread(json, 1, n, f) != (size_t) n) json[0] = '\0';
+		fclose(f);
+	}
 
-	int w = ship->w;
-	int h = ship->h;
-	double t = ship->theta;
-	int th_x = ship->x + w/2 + ((-w/2 - 4) * cos(t)) - th_w/2;
-	int th_y = ship->y + h/2 - ((-w/2 - 4) * sin(t)) - th_h/2;
+	// Phase timings need the profiler built in. Update times never include
+	// it, but the collision counters still cost a little when it is.
+	loadShapes();
+	Profile* prof = NULL;
+#ifdef PROFILE
+	prof = openProfile(NULL);
+#endif // PROFILE
+
+	printf("%-15s %7s %7s %10s", "scenario", "frames", "peak", "update");
+	for(int k = 0; prof && k < BENCH_PHASES; k++) printf(" %9s", phaseName(k));
+	printf("%s\n", json ? "  vs baseline" : "");
+
+	BenchResult res[NUM_SCENARIOS];
+	int regressions = 0;
+	int changed = 0;
+	for(int i = 0; i < NUM_SCENARIOS; i++) {
+		const Scenario* sc = &scenarios[i];
+		res[i] = runScenario(sc, prof);
+		printf("%-15s %7ld %7d %10.0f", sc->name, sc->frames, res[i].peak,
+				res[i].update);
+		for(int k = 0; prof && k < BENCH_PHASES; k++) {
+			printf(" %9.0f", res[i].phases[k]);
+		}
 
-	SDL_Rect src = { 0, 0, th_w, th_h };
-	SDL_Rect dst = { th_x, th_y, th_w, th_h };
-	double rot = -t * (180.0 / M_PI);
+		double base = json ? baselineTime(json, sc->name) : -1;
+		if(base > 0) {
+			double change = (res[i].update / base - 1) * 100;
+			bool slow = change > threshold;
+			regressions += slow;
+			printf("  %+6.1f%%%s", change, slow ? "  REGRESSION" : "");
+		}
+		else if(json) printf("  no baseline");
 
-	SDL_Texture* tex = loadTexture("graphics/thrust.bmp");
-	SDL_RenderCopyEx(renderer, tex, &src, &dst, rot, NULL, SDL_FLIP_NONE);
-	SDL_DestroyTexture(tex);
-}
+		// The ship is kept apart from the pool, so the peak is the rocks alone
+		if(sc->fixed && res[i].peak != sc->rocks) {
+			changed++;
+			printf("  ROCKS CHANGED");
+		}
+		printf("\n");
+	}
+	printf("All times in ns per frame. Updates are the fastest of %d runs "
+			"with the profiler off\n", BENCH_REPEATS);
+	if(changed) {
+		printf("%d fixed scenarios did not keep their rock count\n", changed);
+	}
 
-// Render the entire game state each frame
-void renderGame(const State* st)
-{
-	// Ship
-	renderSprite(st->ship);
+	if(json) {
+		printf("%d of %d scenarios more than %.1f%% slower than %s\n",
+				regressions, NUM_SCENARIOS, threshold, baseline);
+	}
+	if(out && !writeBench(out, res, prof != NULL)) {
+		fprintf(stderr, "Error: Can't write baseline %s\n", out);
+		regressions++;
+	}
+	else if(out) printf("Baseline written to %s\n", out);
 
-	if(st->thrust) renderThrust(st->ship);
+	if(prof) closeProfile(prof);
+	free(json);
+	return regressions + changed > 0;
+}
 
-	// Sprites
-	for(SpriteList* a = st->sprites; a; a = a->next) renderSprite(a->sprite);
+// Interactive game, simulated on its own thread. The main thread owns the
+// window: it passes in the keyboard state and a quit request, and draws the
+// frames the simulation publishes. Fields shared by the two threads are only
+// touched through atomics.
+typedef struct Sim
+{
+	State st;
+	Media* media;
+	TripleBuffer frames;
+	bool hitboxes;
+	Uint64 step;
+
+	// Recording to make, or rewind ring to keep when not recording
+	const char* record_path;
+	Recording rec;
+	Rewind rw;
+
+	// Shared with the main thread
+	int input;
+	bool rewind;
+	bool quit;
+	bool done;
+}
+Sim;
 
-	// Score
-	renderScore(st->score);
+// Simulation thread. The game steps at a fixed rate, however fast frames are
+// drawn: elapsed time builds up in an accumulator and is spent one step at a
+// time, and each batch of steps is published as a frame stamped with the
+// time its last step was due.
+void* runSim(void* arg)
+{
+	Sim* sim = arg;
+	State* st = &sim->st;
+	Frame* f = &sim->frames.frames[sim->frames.back];
+	Uint64 step = sim->step;
+	Uint64 last = SDL_GetPerformanceCounter();
+	Uint64 acc = step;
+	bool dead = false;
+	while(!dead && !__atomic_load_n(&sim->quit, __ATOMIC_ACQUIRE)) {
+		// Bank the time since the last steps, dropping what a slow machine
+		// could not catch up on rather than spiralling
+		Uint64 t = SDL_GetPerformanceCounter();
+		acc += t - last;
+		last = t;
+		if(acc > step * MAX_CATCHUP) acc = step * MAX_CATCHUP;
+
+		// Step the game state once per step of banked time, based on the
+		// keyboard state the main thread last saw
+		int input = __atomic_load_n(&sim->input, __ATOMIC_RELAXED);
+		bool rewind = __atomic_load_n(&sim->rewind, __ATOMIC_RELAXED);
+		bool stepped = acc >= step;
+		while(acc >= step && !dead) {
+			if(rewind) popRewind(&sim->rw, st);
+			else {
+				if(sim->record_path) recordInput(&sim->rec, input);
+				else pushRewind(&sim->rw, st);
+				dead = updateGame(st, input);
+			}
+			flushSfx(sim->media, &st->sfx, st->thrust && !rewind && !dead);
+			acc -= step;
+		}
+		if(stepped && !dead) {
+			makeFrame(f, st, t - acc, sim->hitboxes);
+			f = publishFrame(&sim->frames);
+		}
 
-	// Laser cooldown bar
-	renderCooldown(st->laser_cooldown);
+		// Sleep until the next step is due
+		Uint64 busy = acc + SDL_GetPerformanceCounter() - last;
+		if(busy < step) {
+			SDL_Delay((step - busy) * 1000 / SDL_GetPerformanceFrequency());
+		}
+	}
+	__atomic_store_n(&sim->done, true, __ATOMIC_RELEASE);
+	return NULL;
 }
 
 int main(int argc, char** argv)
 {
+	// Options for headless runs
+	bool headless = false;
+	uint64_t seed = 1;
+	long frames = 100000;
+	int policy = POLICY_THRUST;
+	long games = 0;
+	int step = 1;
+	int threads = 0;
+	const char* profile_path = NULL;
+	const char* record_path = NULL;
+	const char* replay_path = NULL;
+	bool bench = false;
+	const char* baseline_path = NULL;
+	const char* bench_out = NULL;
+	double threshold = 10;
+
+	// Window, renderer and assets for interactive play
+	Media media = { 0 };
+
 	// Parse command line arguments
-	if(argc > 1) {
-		if(!strcmp(argv[1], "-v") || !strcmp(argv[1], "--version")) {
+	for(int i = 1; i < argc; i++) {
+		if(!strcmp(argv[i], "-v") || !strcmp(argv[i], "--version")) {
 			printf("FormA 1.0.0\n");
 			return 0;
 		}
-		else if(!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+		else if(!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
 			printf("\nFormA 1.0.0\n\n");
 			printf("Options\n");
 			printf("----------------\n");
 			printf("-v, --version        print version information\n");
-			printf("-h, --help           print help text\n\n");
+			printf("-h, --help           print help text\n");
+			printf("-d, --debug          show hitboxes, run at a third of the speed and\n");
+			printf("                     print how long each part of startup took\n");
+			printf("--vsync              present frames in step with the display, drawing\n");
+			printf("                     between simulation steps on fast displays\n");
+			printf("--headless           simulate without a window, audio or frame cap\n");
+			printf("--seed N             random seed for --headless (default 1)\n");
+			printf("--frames N           frames to simulate with --headless (default 100000)\n");
+			printf("--input POLICY       scripted player for --headless: thrust, idle,\n");
+			printf("                     spin or random (default thrust)\n");
+			printf("--step N             with --headless, move N frames per update, with\n");
+			printf("                     collisions swept over the whole step (default 1)\n");
+			printf("--games N            with --headless, play N separate games of at\n");
+			printf("                     most --frames frames each in parallel\n");
+			printf("--threads N          worker threads: games run in parallel with --games\n");
+			printf("                     (default one per CPU), otherwise threads sharing\n");
+			printf("                     collision detection when there are many sprites\n");
+			printf("                     (default 1)\n");
+			printf("--profile FILE       write per-frame phase timings and counters as a\n");
+			printf("                     Chrome trace, or as CSV if FILE ends in .csv\n");
+			printf("                     (needs a build with DEFS=-DPROFILE)\n");
+			printf("--record FILE        save the seed and every frame's input to FILE\n");
+			printf("--replay FILE        play a recorded game back headless at full speed\n");
+			printf("--bench              time updateGame on synthetic scenarios, and its\n");
+			printf("                     phases in a build with DEFS=-DPROFILE\n");
+			printf("--baseline FILE      with --bench, compare with a saved baseline\n");
+			printf("--threshold PCT      with --baseline, fail on any scenario more than\n");
+			printf("                     PCT percent slower (default 10)\n");
+			printf("--bench-out FILE     with --bench, save the results as a baseline\n\n");
+			printf("Hold Backspace while playing to rewind up to 10 seconds.\n\n");
 			return 0;
 		}
-		else if(!strcmp(argv[1], "-d") || !strcmp(argv[1], "--debug")) {
-			debug = true;
+		else if(!strcmp(argv[i], "-d") || !strcmp(argv[i], "--debug")) {
+			media.debug = true;
+		}
+		else if(!strcmp(argv[i], "--vsync")) {
+			media.vsync = true;
+		}
+		else if(!strcmp(argv[i], "--headless")) {
+			headless = true;
+		}
+		else if(!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		}
+		else if(!strcmp(argv[i], "--frames") && i + 1 < argc) {
+			frames = strtol(argv[++i], NULL, 10);
+		}
+		else if(!strcmp(argv[i], "--games") && i + 1 < argc) {
+			games = strtol(argv[++i], NULL, 10);
+		}
+		else if(!strcmp(argv[i], "--step") && i + 1 < argc) {
+			step = atoi(argv[++i]);
+			if(step < 1) {
+				printf("Step must be at least 1\n");
+				return 0;
+			}
+		}
+		else if(!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		}
+		else if(!strcmp(argv[i], "--record") && i + 1 < argc) {
+			record_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--replay") && i + 1 < argc) {
+			replay_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--bench")) {
+			bench = true;
+		}
+		else if(!strcmp(argv[i], "--baseline") && i + 1 < argc) {
+			baseline_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+			threshold = strtod(argv[++i], NULL);
+		}
+		else if(!strcmp(argv[i], "--bench-out") && i + 1 < argc) {
+			bench_out = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--profile") && i + 1 < argc) {
+			profile_path = argv[++i];
+		}
+		else if(!strcmp(argv[i], "--input") && i + 1 < argc) {
+			i++;
+			for(policy = 0; policy < NUM_POLICIES; policy++) {
+				if(!strcmp(argv[i], policy_names[policy])) break;
+			}
+			if(policy == NUM_POLICIES) {
+				printf("Unknown input policy: %s\n", argv[i]);
+				return 0;
+			}
 		}
 		else {
-			printf("Unknown option: %s\n", argv[1]);
+			printf("Unknown option: %s\n", argv[i]);
 			printf("Use -h or --help to see a list of available options.\n");
 			return 0;
 		}
 	}
 
+	// Headless runs skip SDL entirely
+	if(bench) return runBench(baseline_path, threshold, bench_out);
+
+	// Open the profile, if one was asked for and can be recorded
+	Profile* prof = NULL;
+	if(profile_path && headless && games > 0) {
+		printf("--profile times a single game, it can't be used with --games\n");
+		return 0;
+	}
+	if(profile_path) {
+#ifndef PROFILE
+		printf("Profiling is not built in, rebuild with DEFS=-DPROFILE\n");
+		return 0;
+#endif // PROFILE
+		prof = openProfile(profile_path);
+		if(!prof) {
+			fprintf(stderr, "Error: Can't write %s\n", profile_path);
+			return 1;
+		}
+	}
+
+	if(replay_path) {
+		Recording rec;
+		if(!loadRecording(&rec, replay_path)) {
+			fprintf(stderr, "Error: Can't read recording %s\n", replay_path);
+			return 1;
+		}
+		runReplay(&rec, prof);
+		freeRecording(&rec);
+		if(prof) closeProfile(prof);
+		return 0;
+	}
+
+	if(headless && games > 0) {
+		runBatch(seed, games, frames, policy, step, threads);
+		return 0;
+	}
+	// Threads for collision detection in a single game. Results are the same
+	// whatever the number of threads.
+	Workers* workers = threads > 1 ? startWorkers(threads) : NULL;
+
+	if(headless) {
+		runHeadless(seed, frames, policy, step, prof, workers);
+		if(prof) closeProfile(prof);
+		if(workers) stopWorkers(workers);
+		return 0;
+	}
+
 	// Load game, make initial state
-	State st;
-	if(!loadGame(&st)) {
+	Sim* sim = calloc(1, sizeof(Sim));
+	State* st = &sim->st;
+	Loader loader;
+	Startup startup = { 0 };
+	if(!loadGame(st, &media, &loader, &startup)) {
 		fprintf(stderr, "Error: Initialization Failed\n");
 		return 1;
 	}
-
-	// Game loop
+	st->prof = prof;
+	st->workers = workers;
+	sim->media = &media;
+
+	// Record from the first frame, if asked to. Otherwise keep the last few
+	// seconds of steps to rewind through; a recording can't be rewound.
+	sim->record_path = record_path;
+	startRecording(&sim->rec, st->seed);
+	startRewind(&sim->rw, REWIND_STEPS, REWIND_SPRITES);
+
+	// Publish the starting state, then hand the game to its own thread
+	Uint64 freq = SDL_GetPerformanceFrequency();
+	sim->step = freq / MAX_FPS;
+	if(media.debug) sim->step *= 3;
+	sim->hitboxes = media.debug;
+	sim->frames.back = 0;
+	sim->frames.mid = 1;
+	sim->frames.front = 2;
+	Frame* first = &sim->frames.frames[0];
+	makeFrame(first, st, SDL_GetPerformanceCounter(), sim->hitboxes);
+
+	// Show it while the audio and font finish loading
+	Uint64 t = SDL_GetPerformanceCounter();
+	SDL_RenderClear(media.renderer);
+	renderGame(&media, first, 1, NULL);
+	SDL_RenderPresent(media.renderer);
+	timeStartup(&startup, "first frame", t);
+	finishLoading(&media, &loader, &startup);
+	if(media.debug) {
+		const Startup* logs[] = { &startup, &loader.log };
+		printStartup(logs, 2);
+	}
+	publishFrame(&sim->frames);
+	pthread_t sim_thread;
+	pthread_create(&sim_thread, NULL, runSim, sim);
+
+	// Render loop. Draws the latest published frame, part way to the next
+	// step, and never waits on the simulation. With vsync, presenting waits
+	// for the display, so every refresh is drawn; without it, a frame is
+	// only drawn once.
 	bool quit = false;
-	while(!quit) {
-		// Track how long this frame takes
-		int start_time = SDL_GetTicks();
-
-		// Check if the player quit the game
+	while(!__atomic_load_n(&sim->done, __ATOMIC_ACQUIRE)) {
+		// Check if the player quit the game, and pass on the keyboard state
 		SDL_Event e;
 		while(SDL_PollEvent(&e) != 0) if(e.type == SDL_QUIT) quit = true;
-
-		// Update the game state for this frame, based on current game state
-		// and current keyboard state
+		if(quit) {
+			__atomic_store_n(&sim->quit, true, __ATOMIC_RELEASE);
+			break;
+		}
 		const Uint8* keys = SDL_GetKeyboardState(NULL);
-		if(updateGame(&st, keys)) break;
-
-		// Render changes to screen based on current game state
-		SDL_RenderClear(renderer);
-		renderGame(&st);
-		SDL_RenderPresent(renderer);
+		bool rewind = !record_path && keys[SDL_SCANCODE_BACKSPACE];
+		__atomic_store_n(&sim->input, readInput(keys), __ATOMIC_RELAXED);
+		__atomic_store_n(&sim->rewind, rewind, __ATOMIC_RELAXED);
+
+		bool fresh;
+		const Frame* f = latestFrame(&sim->frames, &fresh);
+		if(!fresh && !media.vsync) {
+			SDL_Delay(1);
+			continue;
+		}
 
-		// Cap framerate at MAX_FPS
-		double ms_per_frame = 1000.0 / MAX_FPS;
-		if(debug) ms_per_frame *= 3;
-		int sleep_time = ms_per_frame - (SDL_GetTicks() - start_time);
-		if(sleep_time > 0) SDL_Delay(sleep_time);
+		// Render changes to screen
+		Uint64 since = SDL_GetPerformanceCounter() - f->time;
+		double alpha = min((double) since / sim->step, 1);
+		SDL_RenderClear(media.renderer);
+		renderGame(&media, f, alpha, prof);
+		SDL_RenderPresent(media.renderer);
+		PROFILE_FRAME(prof);
 	}
+	pthread_join(sim_thread, NULL);
 
 	// Free all resources and exit game
-	printf("Final score: %llu\n", st.score);
-	quitGame(&st);
+	printf("Final score: %llu\n", st->score);
+	if(record_path && !saveRecording(&sim->rec, record_path)) {
+		fprintf(stderr, "Error: Can't write recording %s\n", record_path);
+	}
+	freeRecording(&sim->rec);
+	unloadRewind(&sim->rw);
+	unloadFrames(&sim->frames);
+	quitGame(st, &media);
+	free(sim);
+	if(prof) closeProfile(prof);
+	if(workers) stopWorkers(workers);
 	return 0;
 }
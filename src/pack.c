@@ -0,0 +1,69 @@
+#define _POSIX_C_SOURCE 200112L
+#include "../headers/pack.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Little-endian integers from the mapped file
+static uint64_t get(const unsigned char* b, int n)
+{
+	uint64_t v = 0;
+	for(int i = 0; i < n; i++) v |= (uint64_t) b[i] << (8 * i);
+	return v;
+}
+
+bool openPack(Pack* p, const char* path)
+{
+	memset(p, 0, sizeof(Pack));
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return false;
+
+	// The mapping outlives the descriptor
+	struct stat sb;
+	void* data = MAP_FAILED;
+	if(fstat(fd, &sb) == 0 && sb.st_size >= PACK_HEADER) {
+		data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if(data == MAP_FAILED) return false;
+	p->data = data;
+	p->size = sb.st_size;
+
+	// Header, then every index entry must point inside the file
+	const unsigned char* b = p->data;
+	bool valid = !memcmp(b, "FPAK", 4) && get(b + 4, 4) == PACK_VERSION;
+	uint64_t count = get(b + 8, 4);
+	valid = valid && count <= (p->size - PACK_HEADER) / PACK_ENTRY;
+	for(uint64_t i = 0; valid && i < count; i++) {
+		const unsigned char* e = b + PACK_HEADER + i * PACK_ENTRY;
+		uint64_t offset = get(e + PACK_NAME, 8);
+		uint64_t size = get(e + PACK_NAME + 8, 8);
+		valid = e[PACK_NAME - 1] == '\0' && offset <= p->size
+			&& size <= p->size - offset;
+	}
+	if(!valid) {
+		closePack(p);
+		return false;
+	}
+	p->count = count;
+	return true;
+}
+
+const void* findInPack(const Pack* p, const char* name, size_t* size)
+{
+	for(uint32_t i = 0; i < p->count; i++) {
+		const unsigned char* e = p->data + PACK_HEADER + i * PACK_ENTRY;
+		if(strcmp((const char*) e, name)) continue;
+		*size = get(e + PACK_NAME + 8, 8);
+		return p->data + get(e + PACK_NAME, 8);
+	}
+	return NULL;
+}
+
+void closePack(Pack* p)
+{
+	if(p->data) munmap((void*) p->data, p->size);
+	memset(p, 0, sizeof(Pack));
+}
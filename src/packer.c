@@ -0,0 +1,223 @@
+#include "../headers/constants.h"
+#include "../headers/pack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Offline packer for asset bundles. Reads each asset named on the command
+// line and writes them all to one bundle, named by the paths given:
+//
+//     ./Pack assets.pack graphics/*.bmp graphics/basis33.ttf audio/*.wav
+//
+// WAV files are converted to 16-bit PCM at SAMPLE_RATE with NUM_CHANNELS
+// channels, the format the game opens its audio device with, so the mixer
+// has nothing left to convert when they load. Anything else is stored as is.
+
+typedef struct Asset
+{
+	const char* name;
+	unsigned char* data;
+	size_t size;
+}
+Asset;
+
+// Little-endian integers, in and out of byte buffers
+static uint32_t get(const unsigned char* b, int n)
+{
+	uint32_t v = 0;
+	for(int i = 0; i < n; i++) v |= (uint32_t) b[i] << (8 * i);
+	return v;
+}
+
+static void put(unsigned char* b, uint64_t v, int n)
+{
+	for(int i = 0; i < n; i++) b[i] = (v >> (8 * i)) & 0xFF;
+}
+
+// Read a whole file, or return NULL
+static unsigned char* readFile(const char* path, size_t* size)
+{
+	FILE* f = fopen(path, "rb");
+	if(!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	long n = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	unsigned char* data = malloc(n > 0 ? n : 1);
+	if(n < 0 || fread(data, 1, n, f) != (size_t) n) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	*size = n;
+	return data;
+}
+
+// Sample of one channel of one frame of 8 or 16-bit PCM, as 16 bits
+static int sample(const unsigned char* pcm, long frame, int ch, int channels,
+		int bits)
+{
+	if(bits == 8) return (pcm[frame * channels + ch] - 128) * 256;
+	return (int16_t) get(&pcm[2 * (frame * channels + ch)], 2);
+}
+
+// Output channel c of a frame: the same channel, the average of all of them
+// when mixing down to mono, or channel c wrapped when there are more outputs
+// than inputs
+static double mixSample(const unsigned char* pcm, long frame, int c,
+		int channels, int bits)
+{
+	if(channels == NUM_CHANNELS) return sample(pcm, frame, c, channels, bits);
+	if(NUM_CHANNELS > 1) return sample(pcm, frame, c % channels, channels, bits);
+	double sum = 0;
+	for(int i = 0; i < channels; i++) sum += sample(pcm, frame, i, channels, bits);
+	return sum / channels;
+}
+
+// Convert a WAV file in place to the mixer's format, resampling linearly.
+// Returns false, leaving it alone, if it isn't 8 or 16-bit PCM.
+static bool convertWav(Asset* a)
+{
+	const unsigned char* b = a->data;
+	if(a->size < 12 || memcmp(b, "RIFF", 4) || memcmp(b + 8, "WAVE", 4)) {
+		return false;
+	}
+
+	// Find the format and data chunks
+	const unsigned char* fmt = NULL;
+	const unsigned char* pcm = NULL;
+	size_t pcm_size = 0;
+	size_t pos = 12;
+	while(pos + 8 <= a->size) {
+		size_t n = get(b + pos + 4, 4);
+		if(n > a->size - pos - 8) n = a->size - pos - 8;
+		if(!memcmp(b + pos, "fmt ", 4) && n >= 16) fmt = b + pos + 8;
+		if(!memcmp(b + pos, "data", 4)) {
+			pcm = b + pos + 8;
+			pcm_size = n;
+		}
+		pos += 8 + n + (n & 1);
+	}
+	if(!fmt || !pcm) return false;
+
+	// PCM, or extensible PCM, of 8 or 16 bits only
+	int format = get(fmt, 2);
+	int channels = get(fmt + 2, 2);
+	long rate = get(fmt + 4, 4);
+	int bits = get(fmt + 14, 2);
+	if((format != 1 && format != 0xFFFE) || (bits != 8 && bits != 16)
+			|| channels < 1 || rate < 1) {
+		return false;
+	}
+	long frames = pcm_size / (channels * bits / 8);
+
+	// Resample every output channel from the matching input channels
+	long out_frames = frames * (double) SAMPLE_RATE / rate;
+	size_t out_size = 44 + (size_t) out_frames * NUM_CHANNELS * 2;
+	unsigned char* out = malloc(out_size);
+	for(long k = 0; k < out_frames; k++) {
+		double t = (double) k * rate / SAMPLE_RATE;
+		long i = t;
+		long j = i + 1 < frames ? i + 1 : i;
+		double f = t - i;
+		for(int c = 0; c < NUM_CHANNELS; c++) {
+			double s0 = mixSample(pcm, i, c, channels, bits);
+			double s1 = mixSample(pcm, j, c, channels, bits);
+			long s = lround(s0 + (s1 - s0) * f);
+			if(s > 32767) s = 32767;
+			if(s < -32768) s = -32768;
+			put(&out[44 + 2 * (k * NUM_CHANNELS + c)], (uint16_t) s, 2);
+		}
+	}
+
+	// Canonical 44 byte header
+	memcpy(out, "RIFF", 4);
+	put(out + 4, out_size - 8, 4);
+	memcpy(out + 8, "WAVEfmt ", 8);
+	put(out + 16, 16, 4);
+	put(out + 20, 1, 2);
+	put(out + 22, NUM_CHANNELS, 2);
+	put(out + 24, SAMPLE_RATE, 4);
+	put(out + 28, SAMPLE_RATE * NUM_CHANNELS * 2, 4);
+	put(out + 32, NUM_CHANNELS * 2, 2);
+	put(out + 34, 16, 2);
+	memcpy(out + 36, "data", 4);
+	put(out + 40, out_size - 44, 4);
+
+	printf("%s: %d channel %ld Hz %d-bit -> %d channel %d Hz 16-bit\n", a->name,
+			channels, rate, bits, NUM_CHANNELS, SAMPLE_RATE);
+	free(a->data);
+	a->data = out;
+	a->size = out_size;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 3) {
+		printf("Usage: %s BUNDLE FILE...\n", argv[0]);
+		return 1;
+	}
+
+	// Read and convert every asset
+	int n = argc - 2;
+	Asset* assets = calloc(n, sizeof(Asset));
+	for(int i = 0; i < n; i++) {
+		Asset* a = &assets[i];
+		a->name = argv[i + 2];
+		if(strlen(a->name) >= PACK_NAME) {
+			fprintf(stderr, "Error: Name too long: %s\n", a->name);
+			return 1;
+		}
+		a->data = readFile(a->name, &a->size);
+		if(!a->data) {
+			fprintf(stderr, "Error: Can't read %s\n", a->name);
+			return 1;
+		}
+		size_t len = strlen(a->name);
+		if(len >= 4 && !strcmp(a->name + len - 4, ".wav") && !convertWav(a)) {
+			printf("%s: not 8 or 16-bit PCM, stored as is\n", a->name);
+		}
+	}
+
+	// Header and index, with data laid out after them
+	size_t index = PACK_HEADER + (size_t) n * PACK_ENTRY;
+	unsigned char* head = calloc(1, index);
+	memcpy(head, "FPAK", 4);
+	put(head + 4, PACK_VERSION, 4);
+	put(head + 8, n, 4);
+	size_t offset = index;
+	for(int i = 0; i < n; i++) {
+		unsigned char* e = head + PACK_HEADER + i * PACK_ENTRY;
+		offset = (offset + PACK_ALIGN - 1) / PACK_ALIGN * PACK_ALIGN;
+		strcpy((char*) e, assets[i].name);
+		put(e + PACK_NAME, offset, 8);
+		put(e + PACK_NAME + 8, assets[i].size, 8);
+		offset += assets[i].size;
+	}
+
+	FILE* f = fopen(argv[1], "wb");
+	if(!f) {
+		fprintf(stderr, "Error: Can't write %s\n", argv[1]);
+		return 1;
+	}
+	fwrite(head, 1, index, f);
+	offset = index;
+	for(int i = 0; i < n; i++) {
+		while(offset % PACK_ALIGN) {
+			fputc(0, f);
+			offset++;
+		}
+		fwrite(assets[i].data, 1, assets[i].size, f);
+		offset += assets[i].size;
+	}
+	if(fclose(f)) {
+		fprintf(stderr, "Error: Can't write %s\n", argv[1]);
+		return 1;
+	}
+	printf("Packed %d assets into %s, %zu bytes\n", n, argv[1], offset);
+
+	for(int i = 0; i < n; i++) free(assets[i].data);
+	free(assets);
+	free(head);
+	return 0;
+}
@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 199309L
+#include "../headers/profile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Names of phases and counters, as they appear in the output
+static const char* phase_names[NUM_PHASES] = {
+	"ship", "move", "collide", "lasers", "despawn", "spawn",
+	"draw_sprites", "draw_hud", "flush"
+};
+static const char* counter_names[NUM_COUNTERS] = {
+	"pairs", "sat", "circle_rejects", "spawns", "despawns"
+};
+
+// Monotonic time in microseconds
+static double micros(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+Profile* openProfile(const char* path)
+{
+	FILE* out = NULL;
+	if(path && !(out = fopen(path, "w"))) return NULL;
+
+	Profile* p = calloc(1, sizeof(Profile));
+	pthread_mutex_init(&p->lock, NULL);
+	p->out = out;
+	size_t len = path ? strlen(path) : 0;
+	p->csv = len >= 4 && !strcmp(path + len - 4, ".csv");
+	p->origin = micros();
+	p->frame_start = p->origin;
+	if(!out) return p;
+
+	// CSV header, or the opening of the trace's event array
+	if(p->csv) {
+		fprintf(out, "frame,total_us");
+		for(int i = 0; i < NUM_PHASES; i++) fprintf(out, ",%s_us", phase_names[i]);
+		for(int i = 0; i < NUM_COUNTERS; i++) fprintf(out, ",%s", counter_names[i]);
+		fprintf(out, "\n");
+	}
+	else fprintf(out, "{\"traceEvents\":[\n");
+	return p;
+}
+
+const char* phaseName(int phase)
+{
+	return phase_names[phase];
+}
+
+void beginPhase(Profile* p, int phase)
+{
+	p->phase_start[phase] = micros();
+}
+
+// A phase can run more than once a frame, like updates catching up before a
+// draw, so its time adds up. The trace gets one event per run.
+void endPhase(Profile* p, int phase)
+{
+	double t = micros();
+	double dur = t - p->phase_start[phase];
+	pthread_mutex_lock(&p->lock);
+	p->elapsed[phase] += dur;
+	if(p->out && !p->csv) {
+		fprintf(p->out, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+				"\"ts\":%.3f,\"dur\":%.3f},\n", phase_names[phase],
+				phase >= PHASE_DRAW_SPRITES, p->phase_start[phase] - p->origin,
+				dur);
+	}
+	pthread_mutex_unlock(&p->lock);
+}
+
+void countEvents(Profile* p, int counter, long n)
+{
+	pthread_mutex_lock(&p->lock);
+	p->counts[counter] += n;
+	pthread_mutex_unlock(&p->lock);
+}
+
+void endFrame(Profile* p)
+{
+	pthread_mutex_lock(&p->lock);
+	double t = micros();
+	double total = t - p->frame_start;
+	for(int i = 0; i < NUM_PHASES; i++) p->totals[i] += p->elapsed[i];
+
+	if(p->out && p->csv) {
+		fprintf(p->out, "%ld,%.3f", p->frame, total);
+		for(int i = 0; i < NUM_PHASES; i++) fprintf(p->out, ",%.3f", p->elapsed[i]);
+		for(int i = 0; i < NUM_COUNTERS; i++) fprintf(p->out, ",%ld", p->counts[i]);
+		fprintf(p->out, "\n");
+	}
+	else if(p->out) {
+		// The frame as an enclosing event, and its counters as a counter track
+		fprintf(p->out, "{\"name\":\"frame\",\"ph\":\"X\",\"pid\":0,\"tid\":0,"
+				"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%ld}},\n",
+				p->frame_start - p->origin, total, p->frame);
+		fprintf(p->out, "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":0,"
+				"\"ts\":%.3f,\"args\":{", p->frame_start - p->origin);
+		for(int i = 0; i < NUM_COUNTERS; i++) {
+			fprintf(p->out, "%s\"%s\":%ld", i ? "," : "", counter_names[i],
+					p->counts[i]);
+		}
+		fprintf(p->out, "}},\n");
+	}
+
+	// Start the next frame
+	p->frame++;
+	p->frame_start = t;
+	memset(p->elapsed, 0, sizeof(p->elapsed));
+	memset(p->counts, 0, sizeof(p->counts));
+	pthread_mutex_unlock(&p->lock);
+}
+
+void closeProfile(Profile* p)
+{
+	// JSON has no trailing commas, so close with an event that needs none
+	if(p->out && !p->csv) {
+		fprintf(p->out, "{\"name\":\"end\",\"ph\":\"i\",\"pid\":0,\"tid\":0,"
+				"\"ts\":%.3f,\"s\":\"g\"}\n]}\n", micros() - p->origin);
+	}
+	if(p->out) fclose(p->out);
+	pthread_mutex_destroy(&p->lock);
+	free(p);
+}
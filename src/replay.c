@@ -0,0 +1,115 @@
+#include "../headers/replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_VERSION 1
+#define MAX_RUN 16
+
+void startRecording(Recording* r, uint64_t seed)
+{
+	memset(r, 0, sizeof(Recording));
+	r->seed = seed;
+}
+
+void recordInput(Recording* r, int input)
+{
+	r->frames++;
+
+	// Extend the last run if it has the same input and room to grow
+	if(r->n > 0) {
+		unsigned char* last = &r->runs[r->n - 1];
+		if((*last & 0xF) == input && (*last >> 4) < MAX_RUN - 1) {
+			*last += 1 << 4;
+			return;
+		}
+	}
+
+	if(r->n == r->cap) {
+		r->cap = r->cap ? r->cap * 2 : 1024;
+		r->runs = realloc(r->runs, r->cap);
+	}
+	r->runs[r->n++] = input & 0xF;
+}
+
+// Little-endian 64-bit integers, so files move between machines
+static void put64(FILE* f, uint64_t v)
+{
+	for(int i = 0; i < 8; i++) fputc((v >> (8 * i)) & 0xFF, f);
+}
+
+static bool get64(FILE* f, uint64_t* v)
+{
+	*v = 0;
+	for(int i = 0; i < 8; i++) {
+		int c = fgetc(f);
+		if(c == EOF) return false;
+		*v |= (uint64_t) c << (8 * i);
+	}
+	return true;
+}
+
+bool saveRecording(const Recording* r, const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if(!f) return false;
+	fwrite("FRMA", 1, 4, f);
+	fputc(REPLAY_VERSION, f);
+	put64(f, r->seed);
+	put64(f, r->frames);
+	fwrite(r->runs, 1, r->n, f);
+	return fclose(f) == 0;
+}
+
+bool loadRecording(Recording* r, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if(!f) return false;
+
+	// Header
+	char magic[4];
+	uint64_t seed, frames;
+	if(fread(magic, 1, 4, f) != 4 || memcmp(magic, "FRMA", 4)
+			|| fgetc(f) != REPLAY_VERSION
+			|| !get64(f, &seed) || !get64(f, &frames)) {
+		fclose(f);
+		return false;
+	}
+	startRecording(r, seed);
+
+	// Runs, until the end of the file
+	int c;
+	while((c = fgetc(f)) != EOF) {
+		if(r->n == r->cap) {
+			r->cap = r->cap ? r->cap * 2 : 1024;
+			r->runs = realloc(r->runs, r->cap);
+		}
+		r->runs[r->n++] = c;
+		r->frames += (c >> 4) + 1;
+	}
+	fclose(f);
+
+	// The runs must add up to the frame count in the header
+	if(r->frames != (long) frames) {
+		freeRecording(r);
+		return false;
+	}
+	return true;
+}
+
+int replayInput(Recording* r)
+{
+	if(r->left == 0) {
+		if(r->pos == r->n) return -1;
+		r->left = (r->runs[r->pos++] >> 4) + 1;
+	}
+	r->left--;
+	return r->runs[r->pos - 1] & 0xF;
+}
+
+void freeRecording(Recording* r)
+{
+	free(r->runs);
+	r->runs = NULL;
+	r->n = r->cap = 0;
+}
@@ -0,0 +1,226 @@
+#include "../headers/sat.h"
+
+#if defined(__AVX__) && !defined(CBMC)
+#include <immintrin.h>
+#define SAT_AVX
+#elif defined(__SSE2__) && !defined(CBMC)
+#include <emmintrin.h>
+#define SAT_SSE2
+#endif
+
+bool satScalar(const Hitbox* h1, const Hitbox* h2)
+{
+	// Nested for loop to compare each bounding box pair
+	for(int i = 0; i < h1->n; i++) {
+		for(int j = 0; j < h2->n; j++) {
+
+			// Rotated positions for every point, cached after the last move
+			const double* r_bb1 = h1->corners[i];
+			const double* r_bb2 = h2->corners[j];
+
+			// Separating axis algorithm
+			bool collision = true;
+			for(int k = 0; k < 4; k++) {
+
+				// Get axis vector and bounding box to check it against
+				const double* axis_bb = &r_bb1[0];
+				const double* other_bb = &r_bb2[0];
+				if(k >= 2) {
+					axis_bb = &r_bb2[0];
+					other_bb = &r_bb1[0];
+				}
+				double axis[4] = { axis_bb[0], axis_bb[1]
+					             , axis_bb[2], axis_bb[3] };
+				if(k & 1) {
+					axis[2] = axis_bb[4];
+					axis[3] = axis_bb[5];
+				}
+
+				// Project each point in other_bb onto the axis to see if there
+				// is overlap. If there is, we can move on to the next axis. If
+				// there's an axis with no overlap, the boxes aren't colliding
+				bool overlap = false;
+				bool left = false;
+				bool right = false;
+				for(int x = 0; x < 4; x++) {
+					double dx = axis[2] - axis[0];
+					double dy = axis[3] - axis[1];
+					double proj = (other_bb[2 * x + 0] - axis[0]) * dx
+					            + (other_bb[2 * x + 1] - axis[1]) * dy;
+					bool proj_left = 0 <= proj;
+					bool proj_right = proj <= dx * dx + dy * dy;
+					if(proj_left) left = true;
+					if(proj_right) right = true;
+					if((!proj_left && !proj_right) || (left && right)) {
+						overlap = true;
+						break;
+					}
+				}
+				if(!overlap) {
+					collision = false;
+					break;
+				}
+			}
+			if(collision) return true;
+		}
+	}
+	return false;
+}
+
+#if defined(SAT_AVX) || defined(SAT_SSE2)
+
+// An edge of a box, from corner 0 to corner 1 or 2, that the other box's
+// corners are projected onto. The arithmetic matches satScalar step for step,
+// which is what keeps the two bit for bit identical.
+typedef struct Axis
+{
+	double x;
+	double y;
+	double dx;
+	double dy;
+	double dd;
+}
+Axis;
+
+static void loadAxes(const double* bb, Axis axes[2])
+{
+	for(int k = 0; k < 2; k++) {
+		const double* end = &bb[2 + 2 * k];
+		axes[k].x = bb[0];
+		axes[k].y = bb[1];
+		axes[k].dx = end[0] - bb[0];
+		axes[k].dy = end[1] - bb[1];
+		axes[k].dd = axes[k].dx * axes[k].dx + axes[k].dy * axes[k].dy;
+	}
+}
+
+// The corners overlap the axis if one projects at or past its start and one
+// at or before its end, or if a corner does neither, which satScalar also
+// counts as overlap (it only happens with NaNs). left and right have one bit
+// per corner.
+static bool overlapMasks(int left, int right)
+{
+	return (left && right) || (~left & ~right & 0xF);
+}
+
+#ifdef SAT_AVX
+
+// A box's four corners, x and y in separate lanes. Corner order is shuffled,
+// which doesn't matter when all four are tested together.
+typedef struct Corners
+{
+	__m256d x;
+	__m256d y;
+}
+Corners;
+
+static Corners loadCorners(const double* bb)
+{
+	__m256d lo = _mm256_loadu_pd(&bb[0]);
+	__m256d hi = _mm256_loadu_pd(&bb[4]);
+	return (Corners) { _mm256_unpacklo_pd(lo, hi), _mm256_unpackhi_pd(lo, hi) };
+}
+
+static bool axisOverlap(const Corners* o, const Axis* a)
+{
+	__m256d proj = _mm256_add_pd(
+			_mm256_mul_pd(_mm256_sub_pd(o->x, _mm256_set1_pd(a->x)),
+				_mm256_set1_pd(a->dx)),
+			_mm256_mul_pd(_mm256_sub_pd(o->y, _mm256_set1_pd(a->y)),
+				_mm256_set1_pd(a->dy)));
+	__m256d left = _mm256_cmp_pd(proj, _mm256_setzero_pd(), _CMP_GE_OQ);
+	__m256d right = _mm256_cmp_pd(proj, _mm256_set1_pd(a->dd), _CMP_LE_OQ);
+	return overlapMasks(_mm256_movemask_pd(left), _mm256_movemask_pd(right));
+}
+
+const char* satKernel(void)
+{
+	return "avx";
+}
+
+#else // SAT_SSE2
+
+// A box's four corners, x and y in separate lanes, two corners per register
+typedef struct Corners
+{
+	__m128d x[2];
+	__m128d y[2];
+}
+Corners;
+
+static Corners loadCorners(const double* bb)
+{
+	Corners c;
+	for(int h = 0; h < 2; h++) {
+		__m128d a = _mm_loadu_pd(&bb[4 * h + 0]);
+		__m128d b = _mm_loadu_pd(&bb[4 * h + 2]);
+		c.x[h] = _mm_unpacklo_pd(a, b);
+		c.y[h] = _mm_unpackhi_pd(a, b);
+	}
+	return c;
+}
+
+static bool axisOverlap(const Corners* o, const Axis* a)
+{
+	int left = 0;
+	int right = 0;
+	for(int h = 0; h < 2; h++) {
+		__m128d proj = _mm_add_pd(
+				_mm_mul_pd(_mm_sub_pd(o->x[h], _mm_set1_pd(a->x)),
+					_mm_set1_pd(a->dx)),
+				_mm_mul_pd(_mm_sub_pd(o->y[h], _mm_set1_pd(a->y)),
+					_mm_set1_pd(a->dy)));
+		left |= _mm_movemask_pd(_mm_cmpge_pd(proj, _mm_setzero_pd())) << (2 * h);
+		right |= _mm_movemask_pd(_mm_cmple_pd(proj, _mm_set1_pd(a->dd))) << (2 * h);
+	}
+	return overlapMasks(left, right);
+}
+
+const char* satKernel(void)
+{
+	return "sse2";
+}
+
+#endif // SAT_AVX
+
+bool satSimd(const Hitbox* h1, const Hitbox* h2)
+{
+	// Split every box into lanes and edges once, rather than once per pair
+	Corners c1[MAX_BB], c2[MAX_BB];
+	Axis a1[MAX_BB][2], a2[MAX_BB][2];
+	for(int i = 0; i < h1->n; i++) {
+		c1[i] = loadCorners(h1->corners[i]);
+		loadAxes(h1->corners[i], a1[i]);
+	}
+	for(int j = 0; j < h2->n; j++) {
+		c2[j] = loadCorners(h2->corners[j]);
+		loadAxes(h2->corners[j], a2[j]);
+	}
+
+	// A pair overlaps if no axis of either box separates them. Each axis takes
+	// all four corners at once, and the first separating axis ends the pair.
+	for(int i = 0; i < h1->n; i++) {
+		for(int j = 0; j < h2->n; j++) {
+			if(axisOverlap(&c2[j], &a1[i][0]) && axisOverlap(&c2[j], &a1[i][1])
+					&& axisOverlap(&c1[i], &a2[j][0])
+					&& axisOverlap(&c1[i], &a2[j][1])) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+#else
+
+bool satSimd(const Hitbox* h1, const Hitbox* h2)
+{
+	return satScalar(h1, h2);
+}
+
+const char* satKernel(void)
+{
+	return "scalar";
+}
+
+#endif // SAT_AVX || SAT_SSE2
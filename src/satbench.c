@@ -0,0 +1,119 @@
+#define _POSIX_C_SOURCE 199309L
+#include "../headers/sat.h"
+#include <time.h>
+
+// Microbenchmark of the separating axis kernels. Builds random hitboxes shaped
+// like the game's (1 to 5 rotated boxes in an 84x84 sprite), keeps the pairs
+// whose enclosing boxes overlap, as colliding() does, and times satScalar
+// against satSimd on them. Every pair must get the same answer from both.
+
+#define NUM_HITBOXES 4096
+#define NUM_PAIRS 100000
+#define REPEATS 20
+
+// Monotonic time in seconds
+static double seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Random hitbox with its top left somewhere in a 160x160 square, so about a
+// third of pairs have overlapping enclosing boxes
+static void randomHitbox(Rng* rng, Hitbox* hb)
+{
+	double x = getRand(rng) * 160;
+	double y = getRand(rng) * 160;
+	double c = cos(getRand(rng) * 2 * M_PI);
+	double sn = sin(getRand(rng) * 2 * M_PI);
+	double cx = x + 42;
+	double cy = y + 42;
+
+	hb->n = 1 + nextRng(rng) % MAX_BB;
+	hb->cx = cx;
+	hb->cy = cy;
+	hb->x0 = hb->y0 = INFINITY;
+	hb->x1 = hb->y1 = -INFINITY;
+	for(int i = 0; i < hb->n; i++) {
+		int bw = 2 + nextRng(rng) % 40;
+		int bh = 2 + nextRng(rng) % 40;
+		int bx = x + nextRng(rng) % (84 - bw);
+		int by = y + nextRng(rng) % (84 - bh);
+		int pts[4][2] = { { bx, by }, { bx + bw, by }, { bx, by + bh },
+			{ bx + bw, by + bh } };
+		for(int k = 0; k < 4; k++) {
+			double px = cx + c * (pts[k][0] - cx) - sn * (cy - pts[k][1]);
+			double py = cy - sn * (pts[k][0] - cx) - c * (cy - pts[k][1]);
+			hb->corners[i][2 * k + 0] = px;
+			hb->corners[i][2 * k + 1] = py;
+			hb->x0 = min(hb->x0, px);
+			hb->y0 = min(hb->y0, py);
+			hb->x1 = max(hb->x1, px);
+			hb->y1 = max(hb->y1, py);
+		}
+	}
+}
+
+// Time one kernel over every pair, REPEATS times. Returns ns per pair and
+// stores each pair's answer.
+static double timeKernel(bool (*sat)(const Hitbox*, const Hitbox*),
+		const Hitbox* hbs, int (*pairs)[2], int n, bool* hits)
+{
+	double start = seconds();
+	for(int r = 0; r < REPEATS; r++) {
+		for(int i = 0; i < n; i++) {
+			hits[i] = sat(&hbs[pairs[i][0]], &hbs[pairs[i][1]]);
+		}
+	}
+	return (seconds() - start) * 1e9 / ((double) n * REPEATS);
+}
+
+int main(void)
+{
+	Rng rng;
+	seedRng(&rng, 1);
+	Hitbox* hbs = malloc(sizeof(Hitbox) * NUM_HITBOXES);
+	for(int i = 0; i < NUM_HITBOXES; i++) randomHitbox(&rng, &hbs[i]);
+
+	// Pairs that get past the enclosing box check
+	int (*pairs)[2] = malloc(sizeof(int[2]) * NUM_PAIRS);
+	int n = 0;
+	while(n < NUM_PAIRS) {
+		int a = nextRng(&rng) % NUM_HITBOXES;
+		int b = nextRng(&rng) % NUM_HITBOXES;
+		const Hitbox* h1 = &hbs[a];
+		const Hitbox* h2 = &hbs[b];
+		if(h1->x1 < h2->x0 || h2->x1 < h1->x0 || h1->y1 < h2->y0
+				|| h2->y1 < h1->y0) {
+			continue;
+		}
+		pairs[n][0] = a;
+		pairs[n][1] = b;
+		n++;
+	}
+
+	bool* scalar_hits = malloc(n);
+	bool* simd_hits = malloc(n);
+	double scalar_ns = timeKernel(satScalar, hbs, pairs, n, scalar_hits);
+	double simd_ns = timeKernel(satSimd, hbs, pairs, n, simd_hits);
+
+	int hits = 0;
+	int mismatches = 0;
+	for(int i = 0; i < n; i++) {
+		hits += scalar_hits[i];
+		mismatches += scalar_hits[i] != simd_hits[i];
+	}
+
+	printf("Pairs: %d (%d colliding), %d repeats\n", n, hits, REPEATS);
+	printf("Scalar: %.1f ns/pair\n", scalar_ns);
+	printf("SIMD (%s): %.1f ns/pair, %.2fx\n", satKernel(), simd_ns,
+			scalar_ns / simd_ns);
+	printf("Mismatches: %d\n", mismatches);
+
+	free(hbs);
+	free(pairs);
+	free(scalar_hits);
+	free(simd_hits);
+	return mismatches != 0;
+}
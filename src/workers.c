@@ -0,0 +1,157 @@
+#include "../headers/workers.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+// Take the next index from a worker's own range, or -1 if it is empty
+static int takeTask(Range* r)
+{
+	int i = -1;
+	pthread_mutex_lock(&r->lock);
+	if(r->lo < r->hi) i = r->lo++;
+	pthread_mutex_unlock(&r->lock);
+	return i;
+}
+
+// Move the back half of another worker's range into worker id's own range.
+// Returns false once every range is empty.
+static bool stealTasks(Workers* w, int id)
+{
+	for(int k = 1; k < w->n; k++) {
+		Range* victim = &w->ranges[(id + k) % w->n];
+		pthread_mutex_lock(&victim->lock);
+		int left = victim->hi - victim->lo;
+		int lo = victim->hi - (left + 1) / 2;
+		int hi = victim->hi;
+		if(left > 0) victim->hi = lo;
+		pthread_mutex_unlock(&victim->lock);
+		if(left <= 0) continue;
+
+		// The thief's own range is empty, so nobody else can be changing it
+		Range* own = &w->ranges[id];
+		pthread_mutex_lock(&own->lock);
+		own->lo = lo;
+		own->hi = hi;
+		own->steals++;
+		pthread_mutex_unlock(&own->lock);
+		return true;
+	}
+	return false;
+}
+
+// Run tasks of the current batch until there are none left anywhere
+static void work(Workers* w, int id)
+{
+	do {
+		int i;
+		while((i = takeTask(&w->ranges[id])) >= 0) w->fn(w->arg, i, id);
+	}
+	while(stealTasks(w, id));
+}
+
+// Thread body: wait for a batch, work on it, report back, repeat
+typedef struct Worker
+{
+	Workers* w;
+	int id;
+}
+Worker;
+
+static void* workerMain(void* arg)
+{
+	Worker self = *(Worker*) arg;
+	free(arg);
+	Workers* w = self.w;
+
+	long seen = 0;
+	for(;;) {
+		pthread_mutex_lock(&w->lock);
+		while(w->batch == seen && !w->quit) pthread_cond_wait(&w->start, &w->lock);
+		if(w->quit) {
+			pthread_mutex_unlock(&w->lock);
+			return NULL;
+		}
+		seen = w->batch;
+		pthread_mutex_unlock(&w->lock);
+
+		work(w, self.id);
+
+		pthread_mutex_lock(&w->lock);
+		if(--w->busy == 0) pthread_cond_signal(&w->done);
+		pthread_mutex_unlock(&w->lock);
+	}
+}
+
+Workers* startWorkers(int n)
+{
+	if(n < 1) n = sysconf(_SC_NPROCESSORS_ONLN);
+	if(n < 1) n = 1;
+
+	Workers* w = calloc(1, sizeof(Workers));
+	w->n = n;
+	w->threads = malloc(sizeof(pthread_t) * n);
+	w->ranges = calloc(n, sizeof(Range));
+	for(int i = 0; i < n; i++) pthread_mutex_init(&w->ranges[i].lock, NULL);
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->start, NULL);
+	pthread_cond_init(&w->done, NULL);
+
+	// Worker 0 is whoever calls runTasks
+	for(int i = 1; i < n; i++) {
+		Worker* self = malloc(sizeof(Worker));
+		self->w = w;
+		self->id = i;
+		pthread_create(&w->threads[i], NULL, workerMain, self);
+	}
+	return w;
+}
+
+void runTasks(Workers* w, int count, Task fn, void* arg)
+{
+	// Deal out equal shares of the batch; stealing evens out the rest
+	for(int i = 0; i < w->n; i++) {
+		Range* r = &w->ranges[i];
+		pthread_mutex_lock(&r->lock);
+		r->lo = (long) count * i / w->n;
+		r->hi = (long) count * (i + 1) / w->n;
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	// Wake the threads, then work alongside them
+	pthread_mutex_lock(&w->lock);
+	w->fn = fn;
+	w->arg = arg;
+	w->busy = w->n - 1;
+	w->batch++;
+	pthread_cond_broadcast(&w->start);
+	pthread_mutex_unlock(&w->lock);
+
+	work(w, 0);
+
+	pthread_mutex_lock(&w->lock);
+	while(w->busy > 0) pthread_cond_wait(&w->done, &w->lock);
+	pthread_mutex_unlock(&w->lock);
+}
+
+long countSteals(const Workers* w)
+{
+	long steals = 0;
+	for(int i = 0; i < w->n; i++) steals += w->ranges[i].steals;
+	return steals;
+}
+
+void stopWorkers(Workers* w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->quit = true;
+	pthread_cond_broadcast(&w->start);
+	pthread_mutex_unlock(&w->lock);
+	for(int i = 1; i < w->n; i++) pthread_join(w->threads[i], NULL);
+
+	for(int i = 0; i < w->n; i++) pthread_mutex_destroy(&w->ranges[i].lock);
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->start);
+	pthread_cond_destroy(&w->done);
+	free(w->ranges);
+	free(w->threads);
+	free(w);
+}